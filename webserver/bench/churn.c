@@ -0,0 +1,143 @@
+/**
+ * \file churn.c
+ * \brief Connection churn benchmark for the web server.
+ *
+ * Keeps a large number of idle connections open while replacing random
+ * ones and timing small requests. The per-request cost should not depend
+ * on the number of idle connections.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/** \brief Start of a request that is never completed, keeping the connection idle */
+const char partialRequest[] = "GET /index.html HTTP/1.0\r\n";
+/** \brief A complete request */
+const char fullRequest[] = "GET /index.html HTTP/1.0\r\n\r\n";
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ */
+long long nowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * Comparison function for sorting latencies with qsort.
+ */
+int compareLatencies(const void * a, const void * b)
+{
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * Connects to the server and sends the given data.
+ * \param addr Address of the server.
+ * \param data Data to send.
+ * \returns The connected socket, -1 on errors.
+ */
+int connectAndSend(const struct sockaddr_in * addr, const char * data)
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == -1)
+    return -1;
+  if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) == -1
+      || write(sock, data, strlen(data)) == -1)
+  {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/**
+ * The main function of the benchmark.
+ * \param argc The argument count
+ * \param argv The command line arguments: port [idle connections] [rounds]
+ */
+int main(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    fputs("usage: churn port [idle connections] [rounds]\n", stderr);
+    return 1;
+  }
+  int port = atoi(argv[1]);
+  int idle = argc > 2 ? atoi(argv[2]) : 50000;
+  int rounds = argc > 3 ? atoi(argv[3]) : 2000;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int * idleSockets = calloc(idle, sizeof(int));
+  long long * latencies = calloc(rounds, sizeof(long long));
+  if (idleSockets == NULL || latencies == NULL)
+  {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+  int i;
+  for (i = 0; i < idle; ++i)
+  {
+    idleSockets[i] = connectAndSend(&addr, partialRequest);
+    if (idleSockets[i] == -1)
+    {
+      perror("Error opening idle connection (raise ulimit -n?)");
+      return 1;
+    }
+  }
+
+  srand(42);
+  char buffer[4096];
+  long long start = nowMicros();
+  for (i = 0; i < rounds; ++i)
+  {
+    /* replace a random idle connection, so closes hit the whole table */
+    int victim = rand() % idle;
+    close(idleSockets[victim]);
+    idleSockets[victim] = connectAndSend(&addr, partialRequest);
+    if (idleSockets[victim] == -1)
+    {
+      perror("Error replacing idle connection");
+      return 1;
+    }
+
+    /* time one complete request */
+    long long requestStart = nowMicros();
+    int sock = connectAndSend(&addr, fullRequest);
+    if (sock == -1)
+    {
+      perror("Error sending request");
+      return 1;
+    }
+    while (read(sock, buffer, sizeof(buffer)) > 0);
+    close(sock);
+    latencies[i] = nowMicros() - requestStart;
+  }
+  long long total = nowMicros() - start;
+
+  qsort(latencies, rounds, sizeof(long long), compareLatencies);
+  printf("idle connections: %d, rounds: %d, %.0f rounds/s\n", idle, rounds, rounds * 1e6 / total);
+  printf("request latency (us): p50 %lld  p99 %lld  max %lld\n",
+         latencies[rounds / 2], latencies[rounds * 99 / 100], latencies[rounds - 1]);
+  for (i = 0; i < idle; ++i)
+    close(idleSockets[i]);
+  free(idleSockets);
+  free(latencies);
+  return 0;
+}
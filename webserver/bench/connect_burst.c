@@ -0,0 +1,142 @@
+/**
+ * \file connect_burst.c
+ * \brief Connection burst benchmark for the web server.
+ *
+ * Opens a burst of connections at once and reports how long the TCP
+ * handshakes took. Dropped SYNs show up as 1s/3s retransmit stalls in
+ * the upper percentiles.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ */
+long long nowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * Comparison function for sorting latencies with qsort.
+ */
+int compareLatencies(const void * a, const void * b)
+{
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * The main function of the benchmark.
+ * \param argc The argument count
+ * \param argv The command line arguments: port [connections] [rounds]
+ */
+int main(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    fputs("usage: connect_burst port [connections per burst] [bursts]\n", stderr);
+    return 1;
+  }
+  int port = atoi(argv[1]);
+  int count = argc > 2 ? atoi(argv[2]) : 1000;
+  int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  struct pollfd * fds = calloc(count, sizeof(struct pollfd));
+  long long * started = calloc(count, sizeof(long long));
+  long long * latencies = calloc((size_t)count * rounds, sizeof(long long));
+  if (fds == NULL || started == NULL || latencies == NULL)
+  {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+  int measured = 0;
+  int failed = 0;
+  int round;
+  for (round = 0; round < rounds; ++round)
+  {
+    int i;
+    /* fire all SYNs at once */
+    for (i = 0; i < count; ++i)
+    {
+      fds[i].fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+      if (fds[i].fd == -1)
+      {
+        perror("Error creating socket (raise ulimit -n?)");
+        return 1;
+      }
+      fds[i].events = POLLOUT;
+      started[i] = nowMicros();
+      if (connect(fds[i].fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 && errno != EINPROGRESS)
+      {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        ++failed;
+      }
+    }
+    /* collect the handshakes */
+    int pending = count;
+    while (pending > 0)
+    {
+      int ready = poll(fds, count, 10000);
+      if (ready <= 0)
+        break;
+      long long now = nowMicros();
+      for (i = 0; i < count; ++i)
+      {
+        if (fds[i].fd == -1 || fds[i].revents == 0)
+          continue;
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error == 0)
+          latencies[measured++] = now - started[i];
+        else
+          ++failed;
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        --pending;
+      }
+    }
+    /* whatever did not finish within the timeout counts as failed */
+    for (i = 0; i < count; ++i)
+      if (fds[i].fd != -1)
+      {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        ++failed;
+      }
+    usleep(100000);
+  }
+
+  qsort(latencies, measured, sizeof(long long), compareLatencies);
+  printf("connections: %d ok, %d failed\n", measured, failed);
+  if (measured > 0)
+    printf("connect latency (us): p50 %lld  p90 %lld  p99 %lld  max %lld\n",
+           latencies[measured / 2], latencies[measured * 9 / 10],
+           latencies[measured * 99 / 100], latencies[measured - 1]);
+  free(fds);
+  free(started);
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * \file large_files.c
+ * \brief Throughput benchmark for large files.
+ *
+ * Downloads files of the document root several times each, over a new
+ * connection every time, and reports the rate at which their content
+ * arrives. The files are expected to exist, for example created with
+ * "head -c 1G /dev/urandom > htdocs/1g.bin" for sizes from 1 MB to 1 GB.
+ * Dropping the page cache in between ("echo 1 > /proc/sys/vm/drop_caches")
+ * measures reads from disk.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/** \brief Size of the buffer the answers are received into */
+#define RECEIVE_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ */
+long long nowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * Comparison function for sorting rates with qsort.
+ */
+int compareRates(const void * a, const void * b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * Requests a file and receives the whole answer.
+ * \param sock The connection to the server.
+ * \param path The path of the file.
+ * \param buffer Receive buffer of \a RECEIVE_BUFFER_SIZE bytes.
+ * \returns The length of the content, -1 on errors.
+ */
+long long receiveFile(int sock, const char * path, char * buffer)
+{
+  char request[512];
+  int length = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\n\r\n", path);
+  if (write(sock, request, length) != length)
+    return -1;
+  /* the headers, the beginning of the content may come along */
+  long long received = 0;
+  char * end = NULL;
+  while (end == NULL)
+  {
+    ssize_t len = read(sock, buffer + received, RECEIVE_BUFFER_SIZE - 1 - received);
+    if (len <= 0)
+      return -1;
+    received += len;
+    buffer[received] = '\0';
+    end = strstr(buffer, "\r\n\r\n");
+  }
+  if (strncmp(buffer, "HTTP/1.1 200", 12) != 0)
+    return -1;
+  char * contentLength = strcasestr(buffer, "\r\nContent-Length:");
+  if (contentLength == NULL || contentLength > end)
+    return -1;
+  long long size = atoll(contentLength + 17);
+  long long left = size - (received - (end + 4 - buffer));
+  while (left > 0)
+  {
+    ssize_t len = read(sock, buffer, left < RECEIVE_BUFFER_SIZE ? left : RECEIVE_BUFFER_SIZE);
+    if (len <= 0)
+      return -1;
+    left -= len;
+  }
+  return size;
+}
+
+/**
+ * Downloads a file over a new connection.
+ * \param addr Address of the server.
+ * \param path The path of the file.
+ * \param buffer Receive buffer of \a RECEIVE_BUFFER_SIZE bytes.
+ * \returns The length of the content, -1 on errors.
+ */
+long long download(const struct sockaddr_in * addr, const char * path, char * buffer)
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == -1)
+    return -1;
+  long long size = -1;
+  if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) == 0)
+    size = receiveFile(sock, path, buffer);
+  close(sock);
+  return size;
+}
+
+/**
+ * The main function of the benchmark.
+ * \param argc The argument count
+ * \param argv The command line arguments: port rounds path...
+ */
+int main(int argc, char * argv[])
+{
+  if (argc < 4)
+  {
+    fputs("usage: large_files port rounds path...\n", stderr);
+    return 1;
+  }
+  int port = atoi(argv[1]);
+  int rounds = atoi(argv[2]);
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  char * buffer = malloc(RECEIVE_BUFFER_SIZE);
+  double * rates = calloc(rounds, sizeof(double));
+  if (buffer == NULL || rates == NULL || rounds <= 0)
+  {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+  int i;
+  for (i = 3; i < argc; ++i)
+  {
+    long long size = 0;
+    int round;
+    for (round = 0; round < rounds; ++round)
+    {
+      long long start = nowMicros();
+      size = download(&addr, argv[i], buffer);
+      if (size < 0)
+      {
+        fprintf(stderr, "Error downloading %s\n", argv[i]);
+        return 1;
+      }
+      long long elapsed = nowMicros() - start;
+      rates[round] = (double)size / (elapsed > 0 ? elapsed : 1) * 1e6 / (1024 * 1024);
+    }
+    qsort(rates, rounds, sizeof(double), compareRates);
+    printf("%s: %lld bytes, MiB/s: min %.0f  median %.0f  max %.0f\n", argv[i], size,
+           rates[0], rates[rounds / 2], rates[rounds - 1]);
+  }
+  free(buffer);
+  free(rates);
+  return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * \file long_poll.c
+ * \brief Long-poll benchmark for the chat service of the web server.
+ *
+ * Parks a chat receiver on one kept-alive connection and wakes it up
+ * repeatedly, timing how long a message takes to reach it. Every round
+ * parks the same connection again, until the server ends it after its
+ * maximum number of requests, so a receiver that is not properly woken up
+ * shows as an error. With "idle" no messages are sent and the
+ * receiver waits for the empty answers the server gives when its long-poll
+ * timeout passes, start it with a short one, e.g. "--longpoll-timeout 1".
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/** \brief Size of the buffer the answers are received into */
+#define RECEIVE_BUFFER_SIZE (64 * 1024)
+/** \brief Time the receiver gets to park before the message is sent, in microseconds */
+#define PARK_DELAY 20000
+
+/** \brief Request that parks a chat receiver */
+const char pollRequest[] = "POST /broadcast.service HTTP/1.1\r\nHost: bench\r\nContent-Length: 0\r\n\r\n";
+/** \brief Request that sends a chat message and closes the connection */
+const char messageRequest[] = "POST /broadcast.service HTTP/1.0\r\nContent-Length: 6\r\n\r\nbench\n";
+
+/**
+ * Returns the current time of the monotonic clock in microseconds.
+ */
+long long nowMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/**
+ * Comparison function for sorting latencies with qsort.
+ */
+int compareLatencies(const void * a, const void * b)
+{
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/**
+ * Connects to the server.
+ * \param addr Address of the server.
+ * \returns The connected socket, -1 on errors.
+ */
+int connectToServer(const struct sockaddr_in * addr)
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == -1)
+    return -1;
+  if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) == -1)
+  {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/**
+ * Receives a whole answer, the connection stays usable for the next request.
+ * \param sock The connection to the server.
+ * \param buffer Receive buffer of \a RECEIVE_BUFFER_SIZE bytes.
+ * \param closing Set to whether the server closes the connection after the answer.
+ * \returns The status code of the answer, -1 on errors.
+ */
+int receiveAnswer(int sock, char * buffer, int * closing)
+{
+  long long received = 0;
+  char * end = NULL;
+  while (end == NULL)
+  {
+    ssize_t len = read(sock, buffer + received, RECEIVE_BUFFER_SIZE - 1 - received);
+    if (len <= 0)
+      return -1;
+    received += len;
+    buffer[received] = '\0';
+    end = strstr(buffer, "\r\n\r\n");
+  }
+  if (strncmp(buffer, "HTTP/1.1 ", 9) != 0)
+    return -1;
+  int status = atoi(buffer + 9);
+  char * connection = strcasestr(buffer, "\r\nConnection: close");
+  *closing = connection != NULL && connection < end;
+  long long size = 0;
+  char * contentLength = strcasestr(buffer, "\r\nContent-Length:");
+  if (contentLength != NULL && contentLength < end)
+    size = atoll(contentLength + 17);
+  long long left = size - (received - (end + 4 - buffer));
+  while (left > 0)
+  {
+    ssize_t len = read(sock, buffer, left < RECEIVE_BUFFER_SIZE ? left : RECEIVE_BUFFER_SIZE);
+    if (len <= 0)
+      return -1;
+    left -= len;
+  }
+  return status;
+}
+
+/**
+ * Sends a chat message over a new connection.
+ * \param addr Address of the server.
+ * \returns 0 on success, -1 on errors.
+ */
+int sendMessage(const struct sockaddr_in * addr)
+{
+  int sock = connectToServer(addr);
+  if (sock == -1)
+    return -1;
+  int result = -1;
+  if (write(sock, messageRequest, strlen(messageRequest)) == (ssize_t)strlen(messageRequest))
+    result = 0;
+  close(sock);
+  return result;
+}
+
+/**
+ * The main function of the benchmark.
+ * \param argc The argument count
+ * \param argv The command line arguments: port rounds [idle]
+ */
+int main(int argc, char * argv[])
+{
+  if (argc < 3)
+  {
+    fputs("usage: long_poll port rounds [idle]\n", stderr);
+    return 1;
+  }
+  int port = atoi(argv[1]);
+  int rounds = atoi(argv[2]);
+  int idle = argc > 3 && strcmp(argv[3], "idle") == 0;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  char * buffer = malloc(RECEIVE_BUFFER_SIZE);
+  long long * latencies = calloc(rounds, sizeof(long long));
+  if (buffer == NULL || latencies == NULL || rounds <= 0)
+  {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+  int receiver = connectToServer(&addr);
+  if (receiver == -1)
+  {
+    perror("Error connecting");
+    return 1;
+  }
+  int round;
+  for (round = 0; round < rounds; ++round)
+  {
+    if (write(receiver, pollRequest, strlen(pollRequest)) != (ssize_t)strlen(pollRequest))
+    {
+      fprintf(stderr, "Error sending long-poll %d\n", round);
+      return 1;
+    }
+    long long start = nowMicros();
+    if (!idle)
+    {
+      usleep(PARK_DELAY);
+      start = nowMicros();
+      if (sendMessage(&addr) == -1)
+      {
+        fprintf(stderr, "Error sending message %d\n", round);
+        return 1;
+      }
+    }
+    int closing;
+    int status = receiveAnswer(receiver, buffer, &closing);
+    if (status != (idle ? 204 : 200))
+    {
+      fprintf(stderr, "Long-poll %d on the kept-alive connection failed (status %d)\n", round, status);
+      return 1;
+    }
+    latencies[round] = nowMicros() - start;
+    if (closing)
+    {
+      close(receiver);
+      receiver = connectToServer(&addr);
+      if (receiver == -1)
+      {
+        perror("Error connecting");
+        return 1;
+      }
+    }
+  }
+  close(receiver);
+  qsort(latencies, rounds, sizeof(long long), compareLatencies);
+  printf("%d long-polls on kept-alive connections, microseconds: min %lld  median %lld  max %lld\n",
+         rounds, latencies[0], latencies[rounds / 2], latencies[rounds - 1]);
+  free(buffer);
+  free(latencies);
+  return 0;
+}
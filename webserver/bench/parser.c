@@ -0,0 +1,126 @@
+/**
+ * \file parser.c
+ * \brief Micro-benchmark of the HTTP request parser.
+ *
+ * Parses a typical browser request in one piece, then a request with a
+ * large header that trickles in small segments. For the latter the
+ * incremental parser is compared with searching the whole buffer for the
+ * end of the head after every segment, as the server used to do.
+ */
+#define _GNU_SOURCE
+
+#include "http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** \brief A request as sent by a browser */
+const char browserRequest[] =
+  "GET /mango-Dateien/banner.png HTTP/1.1\r\n"
+  "Host: localhost:8080\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+  "Accept: image/avif,image/webp,*/*\r\n"
+  "Accept-Language: de,en-US;q=0.7,en;q=0.3\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Connection: keep-alive\r\n"
+  "Referer: http://localhost:8080/mango.xht\r\n"
+  "Sec-Fetch-Dest: image\r\n"
+  "Sec-Fetch-Mode: no-cors\r\n"
+  "Sec-Fetch-Site: same-origin\r\n"
+  "\r\n";
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds.
+ */
+long long nowNanos()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Builds a request with a cookie header of the given size.
+ * \param cookieSize Length of the cookie value.
+ * \returns The request, to be freed by the caller.
+ */
+char * buildLargeRequest(int cookieSize)
+{
+  const char head[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nCookie: ";
+  const char tail[] = "\r\nAccept: */*\r\n\r\n";
+  char * request = malloc(sizeof(head) + cookieSize + sizeof(tail));
+  if (request == NULL)
+  {
+    fputs("Error: Out of memory\n", stderr);
+    exit(1);
+  }
+  strcpy(request, head);
+  memset(request + strlen(head), 'c', cookieSize);
+  strcpy(request + strlen(head) + cookieSize, tail);
+  return request;
+}
+
+int main(int argc, char * argv[])
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+  int cookieSize = argc > 2 ? atoi(argv[2]) : 16 * 1024;
+  int segmentSize = argc > 3 ? atoi(argv[3]) : 64;
+  struct httpRequest request;
+  int i;
+  unsigned int received;
+
+  /* a typical request in one piece */
+  unsigned int length = strlen(browserRequest);
+  long long start = nowNanos();
+  for (i = 0; i < iterations; ++i)
+  {
+    initHttpRequest(&request);
+    if (parseHttpRequest(&request, browserRequest, length) != httpComplete)
+    {
+      fputs("Error: Request not recognized\n", stderr);
+      return 1;
+    }
+  }
+  long long elapsed = nowNanos() - start;
+  printf("browser request (%u bytes, %d headers): %.1f ns/request, %.0f MB/s\n",
+         length, request.headerCount, (double)elapsed / iterations,
+         (double)length * iterations * 1000 / elapsed);
+
+  /* a large request trickling in */
+  char * large = buildLargeRequest(cookieSize);
+  length = strlen(large);
+  char * buffer = malloc(length + 1);
+  int rounds = iterations / 1000 > 0 ? iterations / 1000 : 1;
+  long long incremental = 0, rescanning = 0;
+  for (i = 0; i < rounds; ++i)
+  {
+    initHttpRequest(&request);
+    start = nowNanos();
+    for (received = 0; received < length; )
+    {
+      received = received + segmentSize < length ? received + segmentSize : length;
+      if (parseHttpRequest(&request, large, received) != httpIncomplete)
+        break;
+    }
+    incremental += nowNanos() - start;
+
+    start = nowNanos();
+    for (received = 0; received < length; )
+    {
+      unsigned int next = received + segmentSize < length ? received + segmentSize : length;
+      memcpy(buffer + received, large + received, next - received);
+      received = next;
+      buffer[received] = '\0';
+      if (strstr(buffer, "\r\n\r\n") != 0)
+        break;
+    }
+    rescanning += nowNanos() - start;
+  }
+  printf("%u byte request in %d byte segments: incremental %.1f us, rescanning %.1f us\n",
+         length, segmentSize, incremental / 1000.0 / rounds, rescanning / 1000.0 / rounds);
+  free(buffer);
+  free(large);
+  return 0;
+}
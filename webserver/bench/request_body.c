@@ -0,0 +1,195 @@
+/**
+ * \file request_body.c
+ * \brief Check that the bodies of file requests are skipped.
+ *
+ * A file request may come with a body, which the server does not use. The
+ * body must not pass for the next request on the connection, even when it
+ * looks like one. Sends such requests to a running httpd, with the body in
+ * one piece and trickled in after the head, and counts the answers; a body
+ * too large to skip must be answered with 400 Bad Request.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** \brief Size of the buffer all answers on a connection are received into */
+#define RECEIVE_BUFFER_SIZE (1024 * 1024)
+/** \brief Time between the pieces of a trickled request, in microseconds */
+#define TRICKLE_DELAY 20000
+
+/** \brief A body that would be answered if it was taken for a request */
+const char smuggledRequest[] = "GET /smuggled.html HTTP/1.1\r\nHost: check\r\n\r\n";
+/** \brief The request behind the one with the body */
+const char closingRequest[] = "GET %s HTTP/1.1\r\nHost: check\r\nConnection: close\r\n\r\n";
+
+/**
+ * Connects to the server.
+ * \param addr Address of the server.
+ * \returns The connected socket, -1 on errors.
+ */
+int connectToServer(const struct sockaddr_in * addr)
+{
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock == -1)
+    return -1;
+  if (connect(sock, (const struct sockaddr *)addr, sizeof(*addr)) == -1)
+  {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/**
+ * Writes a whole string to the connection.
+ * \returns 0 on success, -1 on errors.
+ */
+int sendString(int sock, const char * string)
+{
+  ssize_t length = strlen(string);
+  return write(sock, string, length) == length ? 0 : -1;
+}
+
+/**
+ * Receives everything until the server closes the connection and splits it
+ * into answers.
+ * \param sock The connection to the server.
+ * \param buffer Receive buffer of \a RECEIVE_BUFFER_SIZE bytes.
+ * \param statuses Receives the status codes of the first \a maxAnswers answers.
+ * \param maxAnswers Size of \a statuses.
+ * \returns The number of answers, -1 if they cannot be parsed.
+ */
+int receiveAnswers(int sock, char * buffer, int * statuses, int maxAnswers)
+{
+  long long received = 0;
+  ssize_t len;
+  while ((len = read(sock, buffer + received, RECEIVE_BUFFER_SIZE - 1 - received)) > 0)
+    received += len;
+  buffer[received] = '\0';
+  int count = 0;
+  char * answer = buffer;
+  while (answer < buffer + received)
+  {
+    char * end = strstr(answer, "\r\n\r\n");
+    if (end == NULL || strncmp(answer, "HTTP/1.1 ", 9) != 0)
+      return -1;
+    if (count < maxAnswers)
+      statuses[count] = atoi(answer + 9);
+    ++count;
+    long long size = 0;
+    char * contentLength = strcasestr(answer, "\r\nContent-Length:");
+    if (contentLength != NULL && contentLength < end)
+      size = atoll(contentLength + 17);
+    answer = end + 4 + size;
+  }
+  return count;
+}
+
+/**
+ * Sends a file request with a body that looks like a request, followed by
+ * a request for the same file that closes the connection.
+ * \param addr Address of the server.
+ * \param path The path of the file.
+ * \param trickle Whether the body follows the head in small pieces.
+ * \param buffer Receive buffer of \a RECEIVE_BUFFER_SIZE bytes.
+ * \returns 0 if both requests and nothing else were answered with 200 OK, -1 otherwise.
+ */
+int checkSkippedBody(const struct sockaddr_in * addr, const char * path, int trickle, char * buffer)
+{
+  int sock = connectToServer(addr);
+  if (sock == -1)
+    return -1;
+  char head[512];
+  snprintf(head, sizeof(head), "GET %s HTTP/1.1\r\nHost: check\r\nContent-Length: %d\r\n\r\n",
+           path, (int)strlen(smuggledRequest));
+  char next[512];
+  snprintf(next, sizeof(next), closingRequest, path);
+  int result = sendString(sock, head);
+  if (!trickle)
+    result |= sendString(sock, smuggledRequest);
+  else
+  {
+    /* every piece is received on its own */
+    size_t offset;
+    for (offset = 0; offset < strlen(smuggledRequest) && result == 0; offset += 8)
+    {
+      usleep(TRICKLE_DELAY);
+      size_t length = strlen(smuggledRequest) - offset < 8 ? strlen(smuggledRequest) - offset : 8;
+      result = write(sock, smuggledRequest + offset, length) == (ssize_t)length ? 0 : -1;
+    }
+  }
+  result |= sendString(sock, next);
+  int statuses[3];
+  int count = result == 0 ? receiveAnswers(sock, buffer, statuses, 3) : -1;
+  close(sock);
+  if (count != 2 || statuses[0] != 200 || statuses[1] != 200)
+  {
+    fprintf(stderr, "%s body: %d answers instead of 2\n", trickle ? "Trickled" : "Whole", count);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Announces a body too large to be skipped.
+ * \param addr Address of the server.
+ * \param path The path of the file.
+ * \param buffer Receive buffer of \a RECEIVE_BUFFER_SIZE bytes.
+ * \returns 0 if the request was answered with 400 Bad Request alone, -1 otherwise.
+ */
+int checkOversizedBody(const struct sockaddr_in * addr, const char * path, char * buffer)
+{
+  int sock = connectToServer(addr);
+  if (sock == -1)
+    return -1;
+  char head[512];
+  snprintf(head, sizeof(head), "GET %s HTTP/1.1\r\nHost: check\r\nContent-Length: 999999999\r\n\r\n", path);
+  int statuses[1];
+  int count = sendString(sock, head) == 0 ? receiveAnswers(sock, buffer, statuses, 1) : -1;
+  close(sock);
+  if (count != 1 || statuses[0] != 400)
+  {
+    fprintf(stderr, "Oversized body: %d answers, status %d instead of 400\n",
+            count, count > 0 ? statuses[0] : -1);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * The main function of the check.
+ * \param argc The argument count
+ * \param argv The command line arguments: port path
+ */
+int main(int argc, char * argv[])
+{
+  if (argc < 3)
+  {
+    fputs("usage: request_body port path\n", stderr);
+    return 1;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(argv[1]));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  char * buffer = malloc(RECEIVE_BUFFER_SIZE);
+  if (buffer == NULL)
+  {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+  int failed = checkSkippedBody(&addr, argv[2], 0, buffer) == -1;
+  failed |= checkSkippedBody(&addr, argv[2], 1, buffer) == -1;
+  failed |= checkOversizedBody(&addr, argv[2], buffer) == -1;
+  free(buffer);
+  puts(failed ? "Request bodies: FAILED" : "Request bodies: skipped");
+  return failed;
+}
@@ -0,0 +1,174 @@
+/**
+ * \file scan.c
+ * \brief Benchmark of the scalar, SSE2 and AVX2 header scanners.
+ *
+ * Parses browser request heads carrying 4 to 8 KiB of cookies with every
+ * set of scanners the processor supports and reports the throughput in
+ * bytes per (TSC) cycle. Before that, the kernels are checked against the
+ * scalar ones on random data.
+ */
+#define _GNU_SOURCE
+
+#include "http.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> /* __rdtsc */
+#endif
+
+/** \brief Number of cookie sizes to test */
+#define HEAD_COUNT 3
+
+/** \brief Names of the scanner sets to compare */
+const char * kernelNames[] = {"scalar", "sse2", "avx2"};
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds.
+ */
+long long nowNanos()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Returns the time stamp counter, 0 where there is none.
+ */
+unsigned long long cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Builds the head a browser sends for an image, with a session cookie
+ * and a set of tracking cookies adding up to about the given size.
+ * \returns The head, to be freed by the caller.
+ */
+char * buildBrowserHead(int cookieSize)
+{
+  const char head[] =
+    "GET /mango-Dateien/banner.png HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Accept: image/avif,image/webp,*/*\r\n"
+    "Accept-Language: de,en-US;q=0.7,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://localhost:8080/mango.xht\r\n"
+    "Cookie: ";
+  const char tail[] =
+    "\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n";
+  char * request = malloc(sizeof(head) + cookieSize + 64 + sizeof(tail));
+  if (request == NULL)
+  {
+    fputs("Error: Out of memory\n", stderr);
+    exit(1);
+  }
+  strcpy(request, head);
+  int length = strlen(request);
+  int n = 0;
+  while (length < (int)sizeof(head) + cookieSize)
+  {
+    length += sprintf(request + length, "%s_ga_%d=GA1.2.%d.%d",
+                      n > 0 ? "; " : "", n, rand(), rand());
+    ++n;
+  }
+  strcpy(request + length, tail);
+  return request;
+}
+
+/**
+ * Compares the current scanners with the scalar ones on random data.
+ * \returns 1 if they agree everywhere, 0 otherwise.
+ */
+int checkKernels()
+{
+  const struct scanKernels * tested = scanKernels;
+  selectScanKernels("scalar");
+  const struct scanKernels * reference = scanKernels;
+  scanKernels = tested;
+  char data[256];
+  int round, start;
+  for (round = 0; round < 2000; ++round)
+  {
+    unsigned int i;
+    for (i = 0; i < sizeof(data); ++i)
+      /* mostly printable, now and then anything */
+      data[i] = rand() % 64 == 0 ? rand() % 256 : ' ' + rand() % 95;
+    start = rand() % 64;
+    unsigned int end = start + rand() % (sizeof(data) - start);
+    if (tested->token(data, start, end) != reference->token(data, start, end)
+        || tested->text(data, start, end) != reference->text(data, start, end)
+        || tested->value(data, start, end) != reference->value(data, start, end))
+      return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char * argv[])
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+  int cookieSizes[HEAD_COUNT] = {4096, 6144, 8192};
+  char * heads[HEAD_COUNT];
+  unsigned int lengths[HEAD_COUNT];
+  unsigned int total = 0;
+  int i, k, h;
+  for (h = 0; h < HEAD_COUNT; ++h)
+  {
+    heads[h] = buildBrowserHead(cookieSizes[h]);
+    lengths[h] = strlen(heads[h]);
+    total += lengths[h];
+  }
+
+  for (k = 0; k < (int)(sizeof(kernelNames) / sizeof(kernelNames[0])); ++k)
+  {
+    if (!selectScanKernels(kernelNames[k]))
+    {
+      printf("%-6s  not supported\n", kernelNames[k]);
+      continue;
+    }
+    if (!checkKernels())
+    {
+      fprintf(stderr, "Error: %s scanners disagree with the scalar ones\n", kernelNames[k]);
+      return 1;
+    }
+    struct httpRequest request;
+    long long start = nowNanos();
+    unsigned long long startCycles = cycles();
+    for (i = 0; i < iterations; ++i)
+      for (h = 0; h < HEAD_COUNT; ++h)
+      {
+        initHttpRequest(&request);
+        if (parseHttpRequest(&request, heads[h], lengths[h]) != httpComplete
+            || request.headerCount != 11)
+        {
+          fputs("Error: Request not recognized\n", stderr);
+          return 1;
+        }
+      }
+    unsigned long long elapsedCycles = cycles() - startCycles;
+    long long elapsed = nowNanos() - start;
+    double bytes = (double)total * iterations;
+    printf("%-6s  %6.0f ns/request  %6.0f MB/s", kernelNames[k],
+           (double)elapsed / iterations / HEAD_COUNT, bytes * 1000 / elapsed);
+    if (elapsedCycles > 0)
+      printf("  %5.2f bytes/cycle", bytes / elapsedCycles);
+    putchar('\n');
+  }
+  for (h = 0; h < HEAD_COUNT; ++h)
+    free(heads[h]);
+  return 0;
+}
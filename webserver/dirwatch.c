@@ -0,0 +1,337 @@
+/**
+ * \file dirwatch.c
+ * \brief Implementation of the directory watches.
+ */
+#define _GNU_SOURCE
+
+#include "dirwatch.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h> /* PATH_MAX */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/** \brief The events that change what a directory holds */
+#define DIRECTORY_WATCH_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE \
+                                | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF \
+                                | IN_ONLYDIR)
+
+/**
+ * Finds the position of a watch descriptor in the ordered directory list.
+ * \returns The index of the directory with \a wd, or of the first one with
+ * a larger descriptor if there is none.
+ */
+static unsigned int findWatch(const struct directoryWatch * watch, int wd)
+{
+  unsigned int low = 0;
+  unsigned int high = watch->count;
+  while (low < high)
+  {
+    unsigned int middle = (low + high) / 2;
+    if (watch->directories[middle].wd < wd)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+/**
+ * Checks whether a path is a directory or lies below it.
+ */
+static int isBelow(const char * path, const char * directory)
+{
+  size_t length = strlen(directory);
+  return strncmp(path, directory, length) == 0 && (path[length] == '\0' || path[length] == '/');
+}
+
+/**
+ * Records a directory that has a watch. The kernel hands out the same
+ * descriptor for the same directory, then the record is only updated.
+ * \returns 1 on success, 0 if no memory is left.
+ */
+static int addWatchRecord(struct directoryWatch * watch, int wd, const char * path, int depth, int root)
+{
+  unsigned int i = findWatch(watch, wd);
+  struct watchedDirectory * directory = &watch->directories[i];
+  if (i < watch->count && directory->wd == wd)
+  {
+    /* a second path to the same directory, its changes are reported for one */
+    if (strcmp(directory->path, path) != 0)
+      watch->complete = 0;
+    if (depth > directory->depth)
+      directory->depth = depth;
+    directory->root |= root;
+    directory->seen = 1;
+    return 1;
+  }
+  if (watch->count == watch->size)
+  {
+    unsigned int newSize = watch->size == 0 ? 16 : 2 * watch->size;
+    struct watchedDirectory * directories = realloc(watch->directories,
+                                                    newSize * sizeof(struct watchedDirectory));
+    if (directories == NULL)
+      return 0;
+    watch->directories = directories;
+    watch->size = newSize;
+  }
+  char * copy = strdup(path);
+  if (copy == NULL)
+    return 0;
+  directory = &watch->directories[i];
+  memmove(directory + 1, directory, (watch->count - i) * sizeof(struct watchedDirectory));
+  ++watch->count;
+  directory->wd = wd;
+  directory->path = copy;
+  directory->depth = depth;
+  directory->root = root;
+  directory->seen = 1;
+  return 1;
+}
+
+/**
+ * Removes the record at an index of the directory list.
+ */
+static void removeWatchRecord(struct directoryWatch * watch, unsigned int i)
+{
+  free(watch->directories[i].path);
+  --watch->count;
+  memmove(&watch->directories[i], &watch->directories[i + 1],
+          (watch->count - i) * sizeof(struct watchedDirectory));
+}
+
+/**
+ * Watches a directory and the subdirectories below it. The watch comes
+ * first, so subdirectories created while they are listed are reported.
+ * \param watch The watch to add to.
+ * \param path The directory, without trailing slash.
+ * \param depth Levels of subdirectories to watch.
+ * \param root 1 for a directory passed to \a watchDirectory.
+ */
+static void watchTree(struct directoryWatch * watch, const char * path, int depth, int root)
+{
+  int wd = inotify_add_watch(watch->fd, path, DIRECTORY_WATCH_EVENTS);
+  if (wd == -1)
+  {
+    /* a subdirectory may be gone already, then its parent reports it */
+    if (root || (errno != ENOENT && errno != ENOTDIR))
+      watch->complete = 0;
+    return;
+  }
+  if (!addWatchRecord(watch, wd, path, depth, root))
+  {
+    inotify_rm_watch(watch->fd, wd);
+    watch->complete = 0;
+    return;
+  }
+  DIR * dir = opendir(path);
+  if (dir == NULL)
+    return; /* what cannot be listed cannot be watched either, nor served */
+  struct dirent * entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    char child[PATH_MAX];
+    if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child))
+      continue;
+    struct stat childStat;
+    if (stat(child, &childStat) == -1 || !S_ISDIR(childStat.st_mode))
+      continue;
+    if (depth > 0)
+      watchTree(watch, child, depth - 1, 0);
+    else
+      watch->complete = 0;
+  }
+  closedir(dir);
+}
+
+/**
+ * Removes the watches of a directory and of all directories below it.
+ * \param watch The watch.
+ * \param path The directory, without trailing slash.
+ */
+static void unwatchTree(struct directoryWatch * watch, const char * path)
+{
+  unsigned int i = 0;
+  while (i < watch->count)
+  {
+    if (isBelow(watch->directories[i].path, path))
+    {
+      /* fails for deleted directories, the kernel removed their watches already */
+      inotify_rm_watch(watch->fd, watch->directories[i].wd);
+      if (watch->directories[i].root)
+        watch->complete = 0;
+      removeWatchRecord(watch, i);
+    }
+    else
+      ++i;
+  }
+}
+
+/**
+ * Watches the roots anew after changes were lost: new directories get
+ * watches, those of directories that are gone are removed.
+ */
+static void rewatchTrees(struct directoryWatch * watch)
+{
+  unsigned int i;
+  for (i = 0; i < watch->count; ++i)
+    watch->directories[i].seen = 0;
+  unsigned int roots = 0;
+  for (i = 0; i < watch->count; ++i)
+    if (watch->directories[i].root)
+      ++roots;
+  char ** rootPaths = calloc(roots + 1, sizeof(char *));
+  int * rootDepths = calloc(roots + 1, sizeof(int));
+  if (rootPaths == NULL || rootDepths == NULL)
+    watch->complete = 0;
+  else
+  {
+    /* the records move while the trees are watched */
+    roots = 0;
+    for (i = 0; i < watch->count; ++i)
+      if (watch->directories[i].root && (rootPaths[roots] = strdup(watch->directories[i].path)) != NULL)
+        rootDepths[roots++] = watch->directories[i].depth;
+    for (i = 0; i < roots; ++i)
+    {
+      watchTree(watch, rootPaths[i], rootDepths[i], 1);
+      free(rootPaths[i]);
+    }
+  }
+  free(rootPaths);
+  free(rootDepths);
+  i = 0;
+  while (i < watch->count)
+  {
+    if (!watch->directories[i].seen)
+    {
+      inotify_rm_watch(watch->fd, watch->directories[i].wd);
+      removeWatchRecord(watch, i);
+    }
+    else
+      ++i;
+  }
+}
+
+/**
+ * Creates an inotify instance without watches.
+ * \param watch The watch to initialize.
+ * \returns 0 on success, -1 on errors (errno is set).
+ */
+int initDirectoryWatch(struct directoryWatch * watch)
+{
+  memset(watch, 0, sizeof(struct directoryWatch));
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  watch->complete = watch->fd != -1;
+  return watch->fd == -1 ? -1 : 0;
+}
+
+/**
+ * Watches a directory tree. If it cannot be watched completely, the watch
+ * is not complete.
+ * \param watch The watch to add to.
+ * \param path The root of the tree, without trailing slash.
+ * \param depth Levels of subdirectories below \a path to watch, 0 for the
+ * directory itself.
+ */
+void watchDirectory(struct directoryWatch * watch, const char * path, int depth)
+{
+  watchTree(watch, path, depth, 1);
+}
+
+/**
+ * Handles the changes reported so far: drops the cache entries they concern
+ * and follows the directories that were created or removed.
+ * \param watch The watch whose descriptor is readable.
+ * \param cache The cache holding the files below the watched directories.
+ */
+void handleDirectoryEvents(struct directoryWatch * watch, struct fileCache * cache)
+{
+  char buffer[DIRECTORY_WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int overflow = 0;
+  ssize_t length;
+  while ((length = read(watch->fd, buffer, sizeof(buffer))) > 0)
+  {
+    char * position = buffer;
+    while (position < buffer + length)
+    {
+      const struct inotify_event * event = (const struct inotify_event *)position;
+      position += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        overflow = 1;
+        continue;
+      }
+      unsigned int i = findWatch(watch, event->wd);
+      if (i == watch->count || watch->directories[i].wd != event->wd)
+        continue; /* removed already */
+      struct watchedDirectory * directory = &watch->directories[i];
+      if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+      {
+        /* a subdirectory was reported by its parent, a root went away */
+        if (directory->root)
+        {
+          /* the record goes with the watches */
+          char root[PATH_MAX];
+          strcpy(root, directory->path);
+          invalidateCachedFiles(cache, root, 1);
+          unwatchTree(watch, root);
+        }
+        else if (event->mask & IN_IGNORED)
+          removeWatchRecord(watch, i);
+        continue;
+      }
+      if (event->len == 0)
+        continue;
+      char path[PATH_MAX];
+      if (snprintf(path, sizeof(path), "%s/%s", directory->path, event->name) >= (int)sizeof(path))
+        continue; /* too long to be cached */
+      if (!(event->mask & IN_ISDIR))
+      {
+        invalidateCachedFiles(cache, path, 0);
+        continue;
+      }
+      invalidateCachedFiles(cache, path, 1);
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        unwatchTree(watch, path);
+      else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+      {
+        /* the record moves when the new ones are added */
+        int depth = directory->depth;
+        if (depth > 0)
+          watchTree(watch, path, depth - 1, 0);
+        else
+          watch->complete = 0;
+      }
+    }
+  }
+  if (length == -1 && errno != EAGAIN)
+    perror("Error reading directory changes");
+  if (overflow)
+  {
+    ++watch->overflows;
+    invalidateFileCache(cache);
+    rewatchTrees(watch);
+  }
+}
+
+/**
+ * Removes all watches and closes the inotify instance.
+ * \param watch The watch to destroy.
+ */
+void destroyDirectoryWatch(struct directoryWatch * watch)
+{
+  unsigned int i;
+  for (i = 0; i < watch->count; ++i)
+    free(watch->directories[i].path);
+  free(watch->directories);
+  if (watch->fd != -1)
+    close(watch->fd);
+  memset(watch, 0, sizeof(struct directoryWatch));
+  watch->fd = -1;
+}
@@ -0,0 +1,69 @@
+/**
+ * \file dirwatch.h
+ * \brief Reports changes below directories to a file cache, with inotify.
+ *
+ * Every directory of the watched trees gets an inotify watch. When a file
+ * is written, its attributes change, or it is created, deleted or renamed,
+ * the cache entries of its path are dropped; for a directory, those of
+ * everything below it. New subdirectories are watched as they appear. If
+ * the kernel's event queue overflowed, all entries are dropped and the
+ * trees are watched anew.
+ *
+ * The watch is complete as long as every directory a cached file can come
+ * from is watched. If it is not (no watches left, a directory deeper than
+ * allowed, a watched root that went away), the cache has to check its
+ * entries itself. Files reached through symbolic links are watched in the
+ * directory of the link only.
+ */
+
+#ifndef __DIRWATCH__
+#define __DIRWATCH__
+
+#include "filecache.h"
+
+/** \brief Maximal depth of directories below a root that are watched */
+#define DIRECTORY_WATCH_MAX_DEPTH 32
+/** \brief Size of the buffer events are read into */
+#define DIRECTORY_WATCH_BUFFER_SIZE 4096
+
+/** \brief A directory with an inotify watch */
+struct watchedDirectory
+{
+  /** \brief The watch descriptor */
+  int wd;
+  /** \brief The path of the directory, without trailing slash */
+  char * path;
+  /** \brief Levels of subdirectories below it that are watched as well */
+  int depth;
+  /** \brief 1 if the directory was passed to \a watchDirectory */
+  int root;
+  /** \brief Set while the trees are watched anew if the directory is still there */
+  int seen;
+};
+
+/** \brief The watched directories of an event loop */
+struct directoryWatch
+{
+  /** \brief The inotify instance, -1 if there is none */
+  int fd;
+  /** \brief The watched directories, ordered by watch descriptor */
+  struct watchedDirectory * directories;
+  /** \brief Number of valid \a directories */
+  unsigned int count;
+  /** \brief Physical size of \a directories */
+  unsigned int size;
+  /** \brief 1 while every change below the roots is reported */
+  int complete;
+  /** \brief Number of times the event queue overflowed */
+  unsigned long overflows;
+};
+
+int initDirectoryWatch(struct directoryWatch * watch);
+
+void watchDirectory(struct directoryWatch * watch, const char * path, int depth);
+
+void handleDirectoryEvents(struct directoryWatch * watch, struct fileCache * cache);
+
+void destroyDirectoryWatch(struct directoryWatch * watch);
+
+#endif
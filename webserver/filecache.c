@@ -0,0 +1,456 @@
+/**
+ * \file filecache.c
+ * \brief Implementation of the file cache.
+ */
+#define _GNU_SOURCE
+
+#include "filecache.h"
+#include "mime.h"
+#include "snapshot.h"
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Hashes a path with FNV-1a.
+ */
+unsigned int hashPath(const char * path)
+{
+  unsigned int hash = 2166136261u;
+  for (; *path != '\0'; ++path)
+    hash = (hash ^ (unsigned char)*path) * 16777619u;
+  return hash;
+}
+
+/**
+ * Derives the validators of a file from its status: the entity tag from
+ * its inode, size and modification time, and the modification time in
+ * HTTP format. A file modified within the last second may change again
+ * without a new time stamp, so its tag is only weak.
+ * \param fileStat The file's status.
+ * \param info Receives the status and validators.
+ */
+void describeFile(const struct stat * fileStat, struct fileInfo * info)
+{
+  info->stat = *fileStat;
+  int weak = fileStat->st_mtime >= time(NULL) - 1;
+  snprintf(info->etag, FILE_ETAG_SIZE, "%s\"%lx-%lx-%lx.%lx\"", weak ? "W/" : "",
+           (unsigned long)fileStat->st_ino, (unsigned long)fileStat->st_size,
+           (unsigned long)fileStat->st_mtim.tv_sec, (unsigned long)fileStat->st_mtim.tv_nsec);
+  struct tm modifiedGMT;
+  gmtime_r(&fileStat->st_mtime, &modifiedGMT);
+  strftime(info->lastModified, FILE_DATE_SIZE, "%a, %d %b %Y %H:%M:%S GMT", &modifiedGMT);
+}
+
+/**
+ * Checks whether the file system still has the file an entry was loaded from.
+ */
+int sameFile(const struct stat * cached, const struct stat * current)
+{
+  return cached->st_dev == current->st_dev && cached->st_ino == current->st_ino
+         && cached->st_size == current->st_size
+         && cached->st_mtim.tv_sec == current->st_mtim.tv_sec
+         && cached->st_mtim.tv_nsec == current->st_mtim.tv_nsec;
+}
+
+/**
+ * Frees an entry and its content or closes its file.
+ */
+void freeEntry(struct cachedFile * file)
+{
+  if (file->fd != -1)
+    close(file->fd);
+  else if (file->data != 0)
+    free(file->data - file->headerRoom);
+  free(file->path);
+  free(file);
+}
+
+/**
+ * Returns the LRU list an entry belongs to.
+ */
+struct fileLru * lruOf(struct fileCache * cache, const struct cachedFile * file)
+{
+  return file->fd == -1 ? &cache->memoryLru : &cache->descriptorLru;
+}
+
+/**
+ * Takes an entry out of its LRU list.
+ */
+void unlinkLru(struct fileCache * cache, struct cachedFile * file)
+{
+  struct fileLru * lru = lruOf(cache, file);
+  if (file->lruPrev != 0)
+    file->lruPrev->lruNext = file->lruNext;
+  else
+    lru->head = file->lruNext;
+  if (file->lruNext != 0)
+    file->lruNext->lruPrev = file->lruPrev;
+  else
+    lru->tail = file->lruPrev;
+  file->lruPrev = 0;
+  file->lruNext = 0;
+}
+
+/**
+ * Puts an entry at the front of its LRU list.
+ */
+void pushLru(struct fileCache * cache, struct cachedFile * file)
+{
+  struct fileLru * lru = lruOf(cache, file);
+  file->lruPrev = 0;
+  file->lruNext = lru->head;
+  if (lru->head != 0)
+    lru->head->lruPrev = file;
+  else
+    lru->tail = file;
+  lru->head = file;
+}
+
+/**
+ * Removes an entry from the cache. It is freed as soon as no answer is
+ * sent from it any more.
+ */
+void evictEntry(struct fileCache * cache, struct cachedFile * file)
+{
+  struct cachedFile ** link = &cache->buckets[file->hash & (FILE_CACHE_BUCKETS - 1)];
+  while (*link != file)
+    link = &(*link)->hashNext;
+  *link = file->hashNext;
+  unlinkLru(cache, file);
+  file->cached = 0;
+  STATS_SUB(cache->stats.files, 1);
+  if (file->fd != -1)
+    STATS_SUB(cache->stats.descriptors, 1);
+  else
+    STATS_SUB(cache->stats.bytes, file->info.stat.st_size);
+  if (file->references == 0)
+    freeEntry(file);
+}
+
+/**
+ * Creates an entry for an open file: the file is read into memory, or
+ * the entry takes over the descriptor.
+ * \param path The path the file was opened with.
+ * \param fd The open file.
+ * \param fileStat The file's status.
+ * \param inMemory 1 to load the content, 0 to keep the file open.
+ * \returns The entry or 0 if the file could not be loaded.
+ */
+struct cachedFile * loadFile(const char * path, int fd, const struct stat * fileStat, int inMemory)
+{
+  struct cachedFile * file = calloc(1, sizeof(struct cachedFile));
+  if (file == 0)
+    return 0;
+  file->fd = -1;
+  describeFile(fileStat, &file->info);
+  file->contentType = mimeType(path);
+  file->path = strdup(path);
+  size_t size = fileStat->st_size;
+  int loaded = file->path != 0;
+  if (loaded && !inMemory)
+    file->fd = fd;
+  else if (loaded)
+  {
+    /* small files are answered with their headers in front */
+    file->headerRoom = size <= FILE_CACHE_RESPONSE_MAX ? FILE_CACHE_HEADER_ROOM : 0;
+    file->sentInPlace = size >= FILE_CACHE_IN_PLACE_THRESHOLD;
+    char * block = malloc(file->headerRoom + size);
+    file->data = block != 0 ? block + file->headerRoom : 0;
+    size_t done = 0;
+    ssize_t len = 1;
+    while (file->data != 0 && done < size && len > 0)
+    {
+      len = pread(fd, file->data + done, size - done, done);
+      if (len > 0)
+        done += len;
+    }
+    /* a file that shrank while being read is served from disk */
+    loaded = file->data != 0 && done == size;
+  }
+  if (!loaded)
+  {
+    freeEntry(file);
+    return 0;
+  }
+  return file;
+}
+
+/**
+ * Initializes an empty file cache.
+ * \param cache The cache to initialize.
+ * \param maxBytes Upper limit of the bytes held in memory, 0 to hold none.
+ * \param maxDescriptors Upper limit of the files held open, 0 to hold none.
+ * \param checkInterval Time after which an entry is compared with the file
+ * again (ms), 0 to check on every lookup, \a FILE_CACHE_NO_CHECK if changes
+ * are reported with \a invalidateCachedFiles.
+ */
+void initFileCache(struct fileCache * cache, size_t maxBytes, unsigned long maxDescriptors,
+                   unsigned long checkInterval)
+{
+  memset(cache, 0, sizeof(struct fileCache));
+  cache->maxBytes = maxBytes;
+  cache->maxDescriptors = maxDescriptors;
+  cache->checkInterval = checkInterval;
+}
+
+/**
+ * Evicts the least recently used entries of a list while its kind is over
+ * the limit.
+ */
+void shrinkLru(struct fileCache * cache, struct fileLru * lru)
+{
+  while (lru == &cache->memoryLru ? cache->stats.bytes > cache->maxBytes
+                                  : cache->stats.descriptors > cache->maxDescriptors)
+  {
+    evictEntry(cache, lru->tail);
+    STATS_ADD(cache->stats.evictions, 1);
+  }
+}
+
+/**
+ * Looks a file up, without checking or using the entry.
+ * \param cache The cache to search.
+ * \param path The file's path.
+ * \returns The entry or 0 if the file is not cached.
+ */
+struct cachedFile * findCachedFile(const struct fileCache * cache, const char * path)
+{
+  unsigned int hash = hashPath(path);
+  struct cachedFile * file = cache->buckets[hash & (FILE_CACHE_BUCKETS - 1)];
+  while (file != 0 && (file->hash != hash || strcmp(file->path, path) != 0))
+    file = file->hashNext;
+  return file;
+}
+
+/**
+ * Opens a file that is not cached and loads it for the cache: regular
+ * files go to memory if they are small enough, otherwise they are kept
+ * open. Anything else, a directory for example, is not served and closed
+ * right away. Only the limits of the cache are read, so this can run in
+ * any thread while the cache is in use.
+ * \param cache The cache the entry is meant for.
+ * \param path The file's path.
+ * \param fd Receives the file as \a openCachedFile describes it.
+ * \returns The entry, not in the cache yet, or 0 if the file is not to be
+ * cached. Either way it goes to \a addCachedFile.
+ */
+struct cachedFile * loadCachedFile(const struct fileCache * cache, const char * path, int * fd)
+{
+  /* a FIFO would block the open until a writer comes */
+  *fd = open(path, O_RDONLY | O_NONBLOCK);
+  if (*fd == -1)
+    return 0;
+  struct stat fileStat;
+  if (fstat(*fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode))
+  {
+    close(*fd);
+    *fd = -1;
+    return 0;
+  }
+  if (cache->maxBytes == 0 && cache->maxDescriptors == 0)
+    return 0;
+  int inMemory = (size_t)fileStat.st_size <= cache->maxBytes / FILE_CACHE_MAX_SHARE;
+  if (!inMemory && cache->maxDescriptors == 0)
+    return 0;
+  struct cachedFile * file = loadFile(path, *fd, &fileStat, inMemory);
+  if (file == 0)
+    return 0;
+  if (inMemory)
+  {
+    close(*fd);
+    *fd = -1;
+  }
+  file->hash = hashPath(path);
+  return file;
+}
+
+/**
+ * Puts an entry of \a loadCachedFile into the cache, unless a change was
+ * reported since it was loaded or the file got cached meanwhile, then that
+ * entry is used.
+ * \param cache The cache.
+ * \param file The entry or 0 if the file is not to be cached.
+ * \param generation The cache's \a generation before the file was opened.
+ * \param now The current time (ms).
+ * \param fd The descriptor of \a loadCachedFile, receives the one of the
+ * entry that is used.
+ * \returns The entry as \a openCachedFile returns it, 0 if \a file is 0 or
+ * was dropped as possibly outdated (\a fd is -1 then).
+ */
+struct cachedFile * addCachedFile(struct fileCache * cache, struct cachedFile * file,
+                                  unsigned long generation, unsigned long now, int * fd)
+{
+  STATS_ADD(cache->stats.misses, 1);
+  if (file == 0)
+    return 0;
+  struct cachedFile * cached = findCachedFile(cache, file->path);
+  if (generation != cache->generation || cached != 0)
+  {
+    freeEntry(file);
+    *fd = -1;
+    if (cached == 0)
+      return 0;
+    unlinkLru(cache, cached);
+    pushLru(cache, cached);
+    ++cached->references;
+    *fd = cached->fd;
+    return cached;
+  }
+  file->checked = now;
+  file->references = 1;
+  file->cached = 1;
+  struct cachedFile ** bucket = &cache->buckets[file->hash & (FILE_CACHE_BUCKETS - 1)];
+  file->hashNext = *bucket;
+  *bucket = file;
+  pushLru(cache, file);
+  STATS_ADD(cache->stats.files, 1);
+  /* the new entry is at the front, it is never evicted right away */
+  if (file->fd == -1)
+  {
+    STATS_ADD(cache->stats.bytes, file->info.stat.st_size);
+    shrinkLru(cache, &cache->memoryLru);
+  }
+  else
+  {
+    STATS_ADD(cache->stats.descriptors, 1);
+    shrinkLru(cache, &cache->descriptorLru);
+  }
+  return file;
+}
+
+/**
+ * Looks a file up in the cache, loading it on a miss. Regular files go to
+ * memory if they are small enough, otherwise they are kept open, those
+ * that find no room are opened but not cached. Other files are not served.
+ * \param cache The cache to use.
+ * \param path The file's path.
+ * \param now The current time (ms).
+ * \param fd Receives the file to read the answer from: the entry's
+ * descriptor (owned by the entry), a descriptor to be closed by the caller
+ * if the file is not cached, or -1 if the content is in memory or the file
+ * cannot be opened or is not a regular file.
+ * \returns The entry, to be handed back with \a releaseCachedFile, or 0 if
+ * the file is not cached.
+ */
+struct cachedFile * openCachedFile(struct fileCache * cache, const char * path,
+                                   unsigned long now, int * fd)
+{
+  struct cachedFile * file = findCachedFile(cache, path);
+  if (file != 0 && cache->checkInterval != FILE_CACHE_NO_CHECK
+      && now - file->checked >= cache->checkInterval)
+  {
+    struct stat current;
+    if (stat(path, &current) == 0 && sameFile(&file->info.stat, &current))
+    {
+      file->checked = now;
+      /* the tag of a file loaded right after a change becomes strong */
+      if (file->info.etag[0] == 'W')
+        describeFile(&file->info.stat, &file->info);
+    }
+    else
+    {
+      evictEntry(cache, file);
+      STATS_ADD(cache->stats.invalidations, 1);
+      file = 0;
+    }
+  }
+  else if (file != 0 && cache->checkInterval == FILE_CACHE_NO_CHECK && file->info.etag[0] == 'W')
+  {
+    /* changes are reported, so the status of the entry is still the file's */
+    describeFile(&file->info.stat, &file->info);
+  }
+  if (file != 0)
+  {
+    STATS_ADD(cache->stats.hits, 1);
+    unlinkLru(cache, file);
+    pushLru(cache, file);
+    ++file->references;
+    *fd = file->fd;
+    return file;
+  }
+  return addCachedFile(cache, loadCachedFile(cache, path, fd), cache->generation, now, fd);
+}
+
+/**
+ * Drops the entries of a file or of all files below a directory, after
+ * they were found to have changed.
+ * \param cache The cache.
+ * \param path The path of the file or directory, without trailing slash.
+ * \param subtree 1 to drop all entries below \a path as well, 0 for the
+ * entry of \a path only.
+ */
+void invalidateCachedFiles(struct fileCache * cache, const char * path, int subtree)
+{
+  ++cache->generation;
+  size_t length = strlen(path);
+  struct fileLru * lrus[2] = {&cache->memoryLru, &cache->descriptorLru};
+  int i;
+  for (i = 0; i < 2; ++i)
+  {
+    struct cachedFile * file = lrus[i]->head;
+    while (file != 0)
+    {
+      struct cachedFile * next = file->lruNext;
+      if (strncmp(file->path, path, length) == 0
+          && (file->path[length] == '\0' || (subtree && file->path[length] == '/')))
+      {
+        evictEntry(cache, file);
+        STATS_ADD(cache->stats.invalidations, 1);
+      }
+      file = next;
+    }
+  }
+}
+
+/**
+ * Drops all entries, for when it is not known which files changed.
+ * \param cache The cache.
+ */
+void invalidateFileCache(struct fileCache * cache)
+{
+  ++cache->generation;
+  struct fileLru * lrus[2] = {&cache->memoryLru, &cache->descriptorLru};
+  int i;
+  for (i = 0; i < 2; ++i)
+    while (lrus[i]->head != 0)
+    {
+      evictEntry(cache, lrus[i]->head);
+      STATS_ADD(cache->stats.invalidations, 1);
+    }
+}
+
+/**
+ * Hands an entry back after an answer has been sent from it.
+ * \param file The entry, see \a openCachedFile.
+ */
+void releaseCachedFile(struct cachedFile * file)
+{
+  if (file->snapshot != 0)
+    releaseSnapshot(file->snapshot);
+  else if (--file->references == 0 && !file->cached)
+    freeEntry(file);
+}
+
+/**
+ * Frees all entries, including those answers are still being sent from.
+ * \param cache The cache to destroy.
+ */
+void destroyFileCache(struct fileCache * cache)
+{
+  struct fileLru * lrus[2] = {&cache->memoryLru, &cache->descriptorLru};
+  int i;
+  for (i = 0; i < 2; ++i)
+    while (lrus[i]->head != 0)
+    {
+      struct cachedFile * file = lrus[i]->head;
+      lrus[i]->head = file->lruNext;
+      freeEntry(file);
+    }
+  memset(cache, 0, sizeof(struct fileCache));
+}
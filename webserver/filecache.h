@@ -0,0 +1,172 @@
+/**
+ * \file filecache.h
+ * \brief A bounded cache of the files being served, in memory or open.
+ *
+ * Files are kept by path and copied to the heap, a mapping of the file
+ * would fault when it is truncated while being sent. The smallest leave
+ * room in front of their content, so the complete answer, headers and
+ * content, can lie in one piece. Files too
+ * large for memory are kept as open descriptors along with their status,
+ * answers read them at their own offsets. When the cached bytes or
+ * descriptors exceed their limits, the least recently used entries of the
+ * kind are evicted. An entry is checked against the file system at most
+ * once per check interval, in between a hit costs no system call. Where
+ * changes are reported instead (see dirwatch.h), entries are never checked
+ * and are dropped when their file changes. Caches are not thread safe,
+ * every event loop owns its own; only loading a file for a miss may happen
+ * in another thread.
+ */
+
+#ifndef __FILECACHE__
+#define __FILECACHE__
+
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/** \brief Number of hash buckets (a power of two) */
+#define FILE_CACHE_BUCKETS 256
+/** \brief Files from this size on are sent in place instead of being copied to the answer's buffer */
+#define FILE_CACHE_IN_PLACE_THRESHOLD (64 * 1024)
+/** \brief Files up to this size get room for the headers of their answer in front of the content */
+#define FILE_CACHE_RESPONSE_MAX (16 * 1024)
+/** \brief Room for the headers in front of the content of small files */
+#define FILE_CACHE_HEADER_ROOM 512
+/** \brief Files larger than this fraction of the byte limit are kept as descriptors */
+#define FILE_CACHE_MAX_SHARE 8
+/** \brief Size of an ETag including quotes and weakness indicator */
+#define FILE_ETAG_SIZE 64
+/** \brief Size of a date in HTTP format */
+#define FILE_DATE_SIZE 40
+/** \brief Check interval of a cache whose changes are reported, entries are never checked */
+#define FILE_CACHE_NO_CHECK ((unsigned long)-1)
+
+struct snapshot;
+
+/** \brief What the headers of an answer say about a file, see \a describeFile */
+struct fileInfo
+{
+  /** \brief Status of the file */
+  struct stat stat;
+  /** \brief Entity tag including quotes */
+  char etag[FILE_ETAG_SIZE];
+  /** \brief Time of the last modification in HTTP format */
+  char lastModified[FILE_DATE_SIZE];
+};
+
+/** \brief A file held in memory or open */
+struct cachedFile
+{
+  /** \brief The path the file was opened with, the key */
+  char * path;
+  /** \brief Hash of \a path */
+  unsigned int hash;
+  /** \brief The content of the file, \a info.stat.st_size bytes, 0 if it is read from \a fd */
+  char * data;
+  /** \brief The open file if its content is not held in memory, -1 otherwise */
+  int fd;
+  /** \brief 1 if \a data is sent in place after the headers, 0 if it is copied to the answer's buffer */
+  int sentInPlace;
+  /** \brief Bytes in front of \a data where the headers of the answer can go, 0 if there are none */
+  unsigned int headerRoom;
+  /** \brief Length of the headers right in front of \a data, 0 until they are formatted */
+  unsigned int headerLength;
+  /** \brief Offset of the date in those headers */
+  unsigned int dateOffset;
+  /** \brief The second the date in those headers shows */
+  time_t headerDate;
+  /** \brief Status and validators of the file when it was loaded */
+  struct fileInfo info;
+  /** \brief Type of the file, see \a mimeType */
+  const char * contentType;
+  /** \brief The snapshot the entry belongs to, 0 for entries of a file cache */
+  struct snapshot * snapshot;
+  /** \brief Time the entry was last found to match the file (ms) */
+  unsigned long checked;
+  /** \brief Number of answers being sent from the entry */
+  int references;
+  /** \brief 1 while the entry can be found, 0 after its eviction */
+  int cached;
+  /** \brief Next entry in the same hash bucket */
+  struct cachedFile * hashNext;
+  /** \brief More recently used neighbour, 0 for the most recently used entry */
+  struct cachedFile * lruPrev;
+  /** \brief Less recently used neighbour, 0 for the least recently used entry */
+  struct cachedFile * lruNext;
+};
+
+/** \brief Usage counters of a file cache */
+struct fileCacheStats
+{
+  /** \brief Requests served from the cache */
+  unsigned long hits;
+  /** \brief Requests that had to go to the file system */
+  unsigned long misses;
+  /** \brief Entries dropped to make room */
+  unsigned long evictions;
+  /** \brief Entries dropped because their file changed */
+  unsigned long invalidations;
+  /** \brief Number of cached files, in memory or open */
+  unsigned long files;
+  /** \brief Number of cached files held open */
+  unsigned long descriptors;
+  /** \brief Bytes of the cached files */
+  size_t bytes;
+};
+
+/** \brief Entries in order of their last use */
+struct fileLru
+{
+  /** \brief The most recently used entry */
+  struct cachedFile * head;
+  /** \brief The least recently used entry, the next to be evicted */
+  struct cachedFile * tail;
+};
+
+/** \brief The cached files of an event loop */
+struct fileCache
+{
+  /** \brief Hash table of the entries */
+  struct cachedFile * buckets[FILE_CACHE_BUCKETS];
+  /** \brief The entries held in memory */
+  struct fileLru memoryLru;
+  /** \brief The entries held open */
+  struct fileLru descriptorLru;
+  /** \brief Upper limit of \a stats.bytes, 0 disables caching content */
+  size_t maxBytes;
+  /** \brief Upper limit of \a stats.descriptors, 0 disables caching descriptors */
+  unsigned long maxDescriptors;
+  /** \brief Time after which an entry is compared with the file again (ms) */
+  unsigned long checkInterval;
+  /** \brief Number of changes reported so far, see \a addCachedFile */
+  unsigned long generation;
+  /** \brief Usage counters */
+  struct fileCacheStats stats;
+};
+
+unsigned int hashPath(const char * path);
+
+void describeFile(const struct stat * fileStat, struct fileInfo * info);
+
+void initFileCache(struct fileCache * cache, size_t maxBytes, unsigned long maxDescriptors,
+                   unsigned long checkInterval);
+
+struct cachedFile * findCachedFile(const struct fileCache * cache, const char * path);
+
+struct cachedFile * loadCachedFile(const struct fileCache * cache, const char * path, int * fd);
+
+struct cachedFile * addCachedFile(struct fileCache * cache, struct cachedFile * file,
+                                  unsigned long generation, unsigned long now, int * fd);
+
+struct cachedFile * openCachedFile(struct fileCache * cache, const char * path,
+                                   unsigned long now, int * fd);
+
+void invalidateCachedFiles(struct fileCache * cache, const char * path, int subtree);
+
+void invalidateFileCache(struct fileCache * cache);
+
+void releaseCachedFile(struct cachedFile * file);
+
+void destroyFileCache(struct fileCache * cache);
+
+#endif
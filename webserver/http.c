@@ -0,0 +1,301 @@
+/**
+ * \file http.c
+ * \brief Implementation of the incremental HTTP request parser.
+ *
+ * The parser is a state machine whose state and the offset of the token in
+ * progress survive between calls, the views of the finished tokens point
+ * into the caller's buffer. Within a token the scanners of scan.h skip to
+ * the next delimiter, the state machine only looks at the delimiters.
+ */
+#define _GNU_SOURCE
+
+#include "http.h"
+#include "scan.h"
+
+#include <string.h>
+#include <strings.h> /* strncasecmp */
+
+/**
+ * Lets a scanner skip to the end of the current token and leaves the
+ * state machine if that end has not been received yet.
+ */
+#define SKIP_TOKEN(scanner) \
+  i = scanKernels->scanner(data, i, length); \
+  if (i == length) \
+    break; \
+  c = data[i]
+
+/** \brief States of the parser */
+enum parserState
+{
+  stateStart,
+  stateMethod,
+  stateTarget,
+  stateVersion,
+  stateLineFeed,
+  stateHeaderStart,
+  stateHeaderName,
+  stateValueStart,
+  stateValue,
+  stateFinalLineFeed,
+  stateDone
+};
+
+/** \brief Names of the \a httpKnownHeader kinds, in their order */
+static const char * const knownHeaderNames[httpKnownHeaderCount] =
+{
+  "Connection",
+  "Content-Length",
+  "Range",
+  "If-Range",
+  "If-None-Match",
+  "If-Modified-Since"
+};
+
+/**
+ * Finds out whether a header name is one of the known headers. Their names
+ * differ in length, so only one of them needs to be compared.
+ * \returns The \a httpKnownHeader, -1 for other headers.
+ */
+static int lookUpKnownHeader(const char * name, unsigned int length)
+{
+  int header;
+  switch (length)
+  {
+    case 10:
+      header = httpConnection;
+      break;
+    case 14:
+      header = httpContentLength;
+      break;
+    case 5:
+      header = httpRange;
+      break;
+    case 8:
+      header = httpIfRange;
+      break;
+    case 13:
+      header = httpIfNoneMatch;
+      break;
+    case 17:
+      header = httpIfModifiedSince;
+      break;
+    default:
+      return -1;
+  }
+  /* setting the case bit only matches letters of both cases, '-' cannot be confused within a token */
+  const char * known = knownHeaderNames[header];
+  unsigned int i;
+  for (i = 0; i < length; ++i)
+    if ((name[i] | 0x20) != (known[i] | 0x20))
+      return -1;
+  return header;
+}
+
+/**
+ * Points a view at a part of the buffer.
+ */
+void setView(struct httpView * view, const char * data, unsigned int start, unsigned int end)
+{
+  view->data = data + start;
+  view->length = end - start;
+}
+
+/**
+ * Prepares a request for parsing a new head.
+ * \param request The request to reset.
+ */
+void initHttpRequest(struct httpRequest * request)
+{
+  memset(request, 0, sizeof(struct httpRequest));
+  request->state = stateStart;
+}
+
+/**
+ * Parses as much of a request head as is available. The function is called
+ * again with the same (possibly moved, see \a rebaseHttpRequest) and grown
+ * buffer until the head is complete, the bytes parsed before are skipped.
+ * \param request The request, initialized with \a initHttpRequest.
+ * \param data The received bytes, starting with the request.
+ * \param length The number of received bytes.
+ * \returns Whether the head is complete, incomplete or invalid.
+ */
+httpParseResult parseHttpRequest(struct httpRequest * request, const char * data, unsigned int length)
+{
+  if (request->state == stateDone)
+    return httpComplete;
+  unsigned int i;
+  for (i = request->position; i < length; ++i)
+  {
+    unsigned char c = data[i];
+    switch (request->state)
+    {
+      case stateStart:
+        /* empty lines in front of a request are ignored */
+        if (c == '\r' || c == '\n')
+          continue;
+        request->tokenStart = i;
+        request->state = stateMethod;
+        /* fall through */
+      case stateMethod:
+        SKIP_TOKEN(token);
+        if (c != ' ' || i == request->tokenStart)
+          return httpInvalid;
+        setView(&request->method, data, request->tokenStart, i);
+        request->tokenStart = i + 1;
+        request->state = stateTarget;
+        continue;
+      case stateTarget:
+        SKIP_TOKEN(text);
+        if (c != ' ' || i == request->tokenStart)
+          return httpInvalid;
+        setView(&request->target, data, request->tokenStart, i);
+        request->tokenStart = i + 1;
+        request->state = stateVersion;
+        continue;
+      case stateVersion:
+        SKIP_TOKEN(text);
+        if ((c != '\r' && c != '\n') || i == request->tokenStart)
+          return httpInvalid;
+        setView(&request->version, data, request->tokenStart, i);
+        request->state = c == '\r' ? stateLineFeed : stateHeaderStart;
+        continue;
+      case stateLineFeed:
+        if (c != '\n')
+          return httpInvalid;
+        request->state = stateHeaderStart;
+        continue;
+      case stateHeaderStart:
+        if (c == '\r')
+        {
+          request->state = stateFinalLineFeed;
+          continue;
+        }
+        if (c == '\n')
+        {
+          request->state = stateDone;
+          request->length = request->position = i + 1;
+          return httpComplete;
+        }
+        request->tokenStart = i;
+        request->state = stateHeaderName;
+        /* fall through */
+      case stateHeaderName:
+        SKIP_TOKEN(token);
+        if (c != ':' || i == request->tokenStart)
+          return httpInvalid;
+        /* header lines beyond the limit are checked but not kept, unless they are known */
+        if (request->headerCount < HTTP_MAX_HEADERS)
+          setView(&request->headers[request->headerCount].name, data, request->tokenStart, i);
+        request->knownHeader = lookUpKnownHeader(data + request->tokenStart, i - request->tokenStart);
+        request->state = stateValueStart;
+        continue;
+      case stateValueStart:
+        if (c == ' ' || c == '\t')
+          continue;
+        request->tokenStart = i;
+        request->state = stateValue;
+        /* fall through */
+      case stateValue:
+        SKIP_TOKEN(value);
+        if (c != '\r' && c != '\n')
+          return httpInvalid;
+        unsigned int end = i;
+        while (end > request->tokenStart && (data[end - 1] == ' ' || data[end - 1] == '\t'))
+          --end;
+        if (request->headerCount < HTTP_MAX_HEADERS)
+        {
+          setView(&request->headers[request->headerCount].value, data, request->tokenStart, end);
+          ++request->headerCount;
+        }
+        if (request->knownHeader >= 0 && request->knownHeaders[request->knownHeader].data == 0)
+          setView(&request->knownHeaders[request->knownHeader], data, request->tokenStart, end);
+        request->state = c == '\r' ? stateLineFeed : stateHeaderStart;
+        continue;
+      case stateFinalLineFeed:
+        if (c != '\n')
+          return httpInvalid;
+        request->state = stateDone;
+        request->length = request->position = i + 1;
+        return httpComplete;
+    }
+    /* a scanner reached the end of the data */
+    break;
+  }
+  request->position = i;
+  return httpIncomplete;
+}
+
+/**
+ * Moves the views of a request along with the buffer they point into.
+ * \param request The request whose views are adapted.
+ * \param oldData The old location of the buffer.
+ * \param newData The new location of the buffer.
+ */
+void rebaseHttpRequest(struct httpRequest * request, const char * oldData, const char * newData)
+{
+  int i;
+  struct httpView * views[3];
+  views[0] = &request->method;
+  views[1] = &request->target;
+  views[2] = &request->version;
+  for (i = 0; i < 3; ++i)
+    if (views[i]->data != 0)
+      views[i]->data = newData + (views[i]->data - oldData);
+  /* the name of a header in progress is set already */
+  for (i = 0; i <= request->headerCount && i < HTTP_MAX_HEADERS; ++i)
+  {
+    if (request->headers[i].name.data != 0)
+      request->headers[i].name.data = newData + (request->headers[i].name.data - oldData);
+    if (request->headers[i].value.data != 0)
+      request->headers[i].value.data = newData + (request->headers[i].value.data - oldData);
+  }
+  for (i = 0; i < httpKnownHeaderCount; ++i)
+    if (request->knownHeaders[i].data != 0)
+      request->knownHeaders[i].data = newData + (request->knownHeaders[i].data - oldData);
+}
+
+/**
+ * Looks up a header by its name, ignoring case.
+ * \param request A complete request.
+ * \param name The name of the header.
+ * \returns The value of the first header with that name, 0 if there is none.
+ */
+const struct httpView * findHttpHeader(const struct httpRequest * request, const char * name)
+{
+  int i;
+  for (i = 0; i < request->headerCount; ++i)
+    if (httpViewEqualsIgnoreCase(&request->headers[i].name, name))
+      return &request->headers[i].value;
+  return 0;
+}
+
+/**
+ * Looks up one of the known headers, it is found even behind the first
+ * \a HTTP_MAX_HEADERS header lines.
+ * \param request A complete request.
+ * \param header The header.
+ * \returns The value of the first header of that kind, 0 if there is none.
+ */
+const struct httpView * knownHttpHeader(const struct httpRequest * request, httpKnownHeader header)
+{
+  return request->knownHeaders[header].data != 0 ? &request->knownHeaders[header] : 0;
+}
+
+/**
+ * Compares a view with a string.
+ * \returns 1 if both are equal, 0 otherwise.
+ */
+int httpViewEquals(const struct httpView * view, const char * string)
+{
+  return strlen(string) == view->length && memcmp(view->data, string, view->length) == 0;
+}
+
+/**
+ * Compares a view with a string, ignoring case.
+ * \returns 1 if both are equal, 0 otherwise.
+ */
+int httpViewEqualsIgnoreCase(const struct httpView * view, const char * string)
+{
+  return strlen(string) == view->length && strncasecmp(view->data, string, view->length) == 0;
+}
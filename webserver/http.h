@@ -0,0 +1,101 @@
+/**
+ * \file http.h
+ * \brief An incremental parser for HTTP request heads.
+ *
+ * The parser is fed a growing receive buffer and resumes where it stopped,
+ * so every byte is looked at only once. Its results are (pointer, length)
+ * views into that buffer, nothing is copied or modified.
+ */
+
+#ifndef __HTTP__
+#define __HTTP__
+
+/** \brief Maximal number of header lines kept of a request, later ones are parsed but dropped (except for the \a httpKnownHeader ones) */
+#define HTTP_MAX_HEADERS 24
+
+/** \brief A piece of the receive buffer, not terminated by '\\0' */
+struct httpView
+{
+  /** \brief First character */
+  const char * data;
+  /** \brief Number of characters */
+  unsigned int length;
+};
+
+/** \brief A header line */
+struct httpHeader
+{
+  /** \brief Name of the header without the colon */
+  struct httpView name;
+  /** \brief Value without surrounding white space */
+  struct httpView value;
+};
+
+/** \brief Headers the server acts on, recorded wherever they are in the head */
+typedef enum
+{
+  httpConnection,
+  httpContentLength,
+  httpRange,
+  httpIfRange,
+  httpIfNoneMatch,
+  httpIfModifiedSince,
+  /** \brief Number of known headers, not a header */
+  httpKnownHeaderCount
+} httpKnownHeader;
+
+/** \brief Outcome of a parser run */
+typedef enum
+{
+  /** \brief The head is not complete yet, call again with more data */
+  httpIncomplete,
+  /** \brief The head is complete */
+  httpComplete,
+  /** \brief The data is not a valid request */
+  httpInvalid
+} httpParseResult;
+
+/** \brief A request head and the state of its parser */
+struct httpRequest
+{
+  /** \brief Request method, e.g. GET */
+  struct httpView method;
+  /** \brief Request target, e.g. /index.html */
+  struct httpView target;
+  /** \brief Protocol version, e.g. HTTP/1.1 */
+  struct httpView version;
+  /** \brief The first \a HTTP_MAX_HEADERS header lines in the order received */
+  struct httpHeader headers[HTTP_MAX_HEADERS];
+  /** \brief Number of complete entries in \a headers */
+  int headerCount;
+  /** \brief Values of the first header of each \a httpKnownHeader kind, no data if there is none */
+  struct httpView knownHeaders[httpKnownHeaderCount];
+  /** \brief Length of the head including the empty line, once it is complete */
+  unsigned int length;
+
+  /* parser state */
+  /** \brief State of the parser's state machine */
+  int state;
+  /** \brief Number of bytes parsed so far */
+  unsigned int position;
+  /** \brief Offset of the token being parsed */
+  unsigned int tokenStart;
+  /** \brief The \a httpKnownHeader of the header line being parsed, -1 for others */
+  int knownHeader;
+};
+
+void initHttpRequest(struct httpRequest * request);
+
+httpParseResult parseHttpRequest(struct httpRequest * request, const char * data, unsigned int length);
+
+void rebaseHttpRequest(struct httpRequest * request, const char * oldData, const char * newData);
+
+const struct httpView * findHttpHeader(const struct httpRequest * request, const char * name);
+
+const struct httpView * knownHttpHeader(const struct httpRequest * request, httpKnownHeader header);
+
+int httpViewEquals(const struct httpView * view, const char * string);
+
+int httpViewEqualsIgnoreCase(const struct httpView * view, const char * string);
+
+#endif
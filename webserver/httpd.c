@@ -2,24 +2,55 @@
  * \file httpd.c
  * \brief A basic web server
  */
+#define _GNU_SOURCE
 
 #include "util.h"
+#include "filecache.h"
 #include "log.h"
+#include "mime.h"
+#include "http.h"
+#include "pool.h"
+#include "scan.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "timer.h"
+#include "workers.h"
 
 /*#define NDEBUG*/
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h> /* INT_MAX */
 #include <netdb.h> /* addrinfo */
 #include <netinet/ip.h>
+#include <netinet/tcp.h> /* TCP_NODELAY */
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stddef.h> /* offsetof */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h> /* iovec */
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_IO_URING
+#include "uring.h"
+#endif
+#ifdef HAVE_INOTIFY
+#include "dirwatch.h"
+#endif
 #include <time.h>
 #include <unistd.h> /* getopt */
 
@@ -27,19 +58,49 @@
 #define BUFFER_SIZE 1024
 /** \brief Maximum size of input buffers (request may not be longer than this) */
 #define MAX_BUFFER_SIZE 1024 * 1024
+/** \brief Number of connection objects allocated at once */
+#define CONNECTIONS_PER_SLAB 64
+/** \brief Free buffer memory each event loop keeps for reuse */
+#define MAX_CACHED_BUFFER_BYTES 8 * 1024 * 1024
 /** \brief Maximum size of requestable urls */
 #define MAX_URL_SIZE 256
 /** \brief Maximum size of the absolute path of any file to be delivered */
 #define MAX_FILE_PATH_SIZE MAX_URL_SIZE + 29
+/** \brief Maximum size of an If-None-Match header honored, longer ones are ignored */
+#define MAX_CONDITION_SIZE 256
+/** \brief Maximal number of ranges of a request, requests for more get the whole file */
+#define MAX_RANGES 8
+/** \brief Separates the parts of multipart/byteranges answers */
+#define MULTIPART_BOUNDARY "KuN-byteranges-3f8a2c71d5e6"
+/** \brief Follows the last part of a multipart/byteranges answer */
+#define MULTIPART_END "\r\n--" MULTIPART_BOUNDARY "--\r\n"
+/** \brief Space the headers of one part of a multipart/byteranges answer take at most */
+#define PART_HEADER_SIZE 256
 /** \brief Document root of the web server (where the web files are located) */
 const char documentRoot[] = "/home/sdoerner/svn/KuN/htdocs";
 /** \brief Set if we want to enable debug output. */
 #define DEBUG
 /** \brief Number of file descriptors to check when calling poll */
 #define FDCOUNT 2
-/** \brief Maximal number of active connections */
-#define MAXCON 10
+/** \brief Default maximal number of active connections, shared among the event loops */
+#define MAXCON 10000
+/** \brief Default maximal memory for connections and their buffers in MiB, shared among the event loops */
+#define DEFAULT_MAX_MEMORY_MB 256
+/** \brief Default size of the file cache in MiB, shared among the event loops */
+#define DEFAULT_FILE_CACHE_MB 64
+/** \brief Default number of files the file cache keeps open, shared among the event loops */
+#define DEFAULT_OPEN_FILES 1000
+/** \brief Default time after which a cached file is compared with the file system again (ms) */
+#define DEFAULT_FILE_CACHE_VALID 1000
+/** \brief Default number of threads that open and read files for the event loops */
+#define DEFAULT_FILE_THREADS 4
+/** \brief Seconds a rejected client is asked to wait before trying again */
+#define RETRY_AFTER_SECONDS "1"
+/** \brief Maximal number of clients accepted per loop iteration, so established connections are not starved */
+#define MAX_ACCEPTS_PER_ITERATION 64
 
+/** \brief Poll struct slots in front of the connections (listening socket, wakeup fd, directory watch) */
+#define RESERVED_POLL_SLOTS 3
 /** \brief The number of slots we overallocate when rebuilding the poll struct */
 #define INITIAL_FREE_SLOTS_IN_POLLSTRUCT 8
 /** \brief The number of slots that may be empty until we downsize the poll struct */
@@ -49,9 +110,115 @@ const char documentRoot[] = "/home/sdoerner/svn/KuN/htdocs";
 #define ACCESSLOG "./logs/access.log"
 /** \brief The error log file */
 #define ERRORLOG "./logs/error.log"
+/** \brief The directory of the error documents */
+#define ERROR_DOCUMENT_DIRECTORY "./error_documents"
+/** \brief The answer to requests for missing files */
+#define NOT_FOUND_DOCUMENT ERROR_DOCUMENT_DIRECTORY "/404.html"
 
 /** \brief The file to save the chat log to. */
 #define CHATLOGFILE "./logs/chat_log"
+/** \brief Default time a client may take to send the request headers (ms) */
+#define DEFAULT_HEADER_TIMEOUT 10000
+/** \brief Default time a client may pause while sending a request body (ms) */
+#define DEFAULT_BODY_TIMEOUT 30000
+/** \brief Default time a client may stall a response by not reading (ms) */
+#define DEFAULT_WRITE_TIMEOUT 30000
+/** \brief Default time a kept-alive connection may be idle between requests (ms) */
+#define DEFAULT_KEEP_ALIVE_TIMEOUT 5000
+/** \brief Default number of requests served over one connection */
+#define DEFAULT_MAX_REQUESTS 100
+/** \brief Default time a chat receiver waits for a message before getting an empty answer (ms) */
+#define DEFAULT_LONG_POLL_TIMEOUT 60000
+
+/** \brief Size of the buffer that collects the answers to pipelined requests */
+#define PIPELINE_BUFFER_SIZE 16 * 1024
+/** \brief Space an answer needs at least for its headers (and the status report) */
+#define ANSWER_RESERVE 1024
+/** \brief Maximum size of the server status report */
+#define STATUS_REPORT_SIZE 512
+/** \brief Url of the chat service */
+#define CHAT_URL "/broadcast.service"
+/** \brief Url of the server status report */
+#define STATUS_URL "/status.service"
+
+/** \brief Maximal number of bytes handed to a single sendfile call or sent from the file cache at once */
+#define SENDFILE_CHUNK_SIZE (1024 * 1024)
+/** \brief Smallest buffer files are read into through user space, unless they are smaller */
+#define FILE_READ_MIN_SIZE (64 * 1024)
+/** \brief Largest buffer files are read into through user space */
+#define FILE_READ_MAX_SIZE (256 * 1024)
+
+/** \brief Maximum number of events fetched by a single call to epoll_wait */
+#define EPOLL_MAX_EVENTS 64
+
+/** \brief Number of submission queue entries of the io_uring instance */
+#define URING_ENTRIES 256
+/** \brief Bits of an io_uring user_data that hold the operation (the rest is the connection) */
+#define URING_OP_MASK 7
+
+/** \brief The mechanisms available for waiting on socket events */
+typedef enum
+{
+  backendPoll,
+  backendEpoll,
+  backendUring
+} backendType;
+
+/** \brief The operations the io_uring engine keeps in flight for a connection */
+typedef enum
+{
+  uringAccept,
+  uringRecv,
+  uringSend,
+  uringRead,
+  uringWatch,
+  uringWakeup,
+  uringCancel,
+  uringSendCached
+} uringOpType;
+
+/** \brief What happens to new clients while a loop is at its limits */
+typedef enum
+{
+  /** \brief Stop accepting, they wait in the listen backlog */
+  overloadPause,
+  /** \brief Accept them, answer 503 and close */
+  overloadReject
+} overloadPolicy;
+
+/** \brief Counters of the load shedding of an event loop */
+struct sheddingStats
+{
+  /** \brief Clients turned away with 503 */
+  unsigned long rejected;
+  /** \brief Number of times accepting was paused */
+  unsigned long pauses;
+};
+
+/** \brief An event loop thread and the descriptors other loops may use to reach it */
+struct eventLoop
+{
+  /** \brief The thread running the loop */
+  pthread_t thread;
+  /** \brief The loop's own listening socket (all share the port with SO_REUSEPORT) */
+  int listeningSocket;
+  /** \brief eventfd to wake the loop up for chat broadcasts, completed file jobs and stopping */
+  int wakeupFd;
+  /** \brief Set when another loop wakes this one up for a chat broadcast */
+  int chatPending;
+  /** \brief The loop's pool of connection objects, for the status report */
+  struct objectPool * connectionPool;
+  /** \brief The loop's pool of buffers, for the status report */
+  struct bufferPool * bufferPool;
+  /** \brief The loop's load shedding counters, for the status report */
+  struct sheddingStats * sheddingStats;
+  /** \brief The loop's file cache, for the status report */
+  struct fileCache * fileCache;
+  /** \brief Number of connections of the loop, for the status report */
+  int * connectionCount;
+  /** \brief Set once the loop is initialized, the status report reads the fields above from then on */
+  int running;
+};
 
 /** \brief The status of a connection */
 typedef enum
@@ -63,109 +230,303 @@ typedef enum
   statusChatSender
 } statusType;
 
-/** \brief All relevant information about an active connection */
+/** \brief A range of bytes of a file, both ends included */
+struct byteRange
+{
+  /** \brief Offset of the first byte */
+  long first;
+  /** \brief Offset of the last byte */
+  long last;
+};
+
+/** \brief Progress of a multipart/byteranges answer */
+struct multipartAnswer
+{
+  /** \brief Content type of the file */
+  const char * contentType;
+  /** \brief Size of the file */
+  long fileSize;
+  /** \brief Number of entries in \a ranges */
+  int rangeCount;
+  /** \brief Part to start next, \a rangeCount for the closing delimiter */
+  int nextPart;
+  /** \brief The requested ranges in request order */
+  struct byteRange ranges[MAX_RANGES];
+};
+
+/**
+ * \brief All relevant information about an active connection
+ *
+ * The fields touched on every event come first and share a cache line,
+ * the ones only needed for particular requests follow.
+ */
 struct connectionType
 {
   /** \brief Status of the connection */
   statusType status;
-  /** \brief File descriptor for the requested file */
-  int fileFd;
   /** \brief File descriptor for the network socket */
   int socketFd;
+  /** \brief File descriptor for the requested file */
+  int fileFd;
+  /** \brief Index of the corresponding entry in the \a pollStruct and \a connectionTable arrays */
+  int pollStructIndex;
   /** \brief First index that has not been written or sent yet */
   unsigned int bufferFreeOffset;
   /** \brief Actual size of sensible content in the buffer */
   unsigned int bufferLength;
   /** \brief Physical size of the buffer */
   unsigned int bufferSize;
-  /** \brief The previous connection in our list */
-  struct connectionType * prev;
-  /** \brief The next connection in our list */
-  struct connectionType * next;
-  /** \brief Index of the corresponding entry in the \a pollStruct array */
-  int pollStructIndex;
+  /** \brief Number of io_uring operations and file jobs still referencing this connection */
+  int pendingOps;
   /** \brief Buffer for information received or to be sent*/
   char * buffer;
+  /** \brief Deadline of the current status */
+  struct timer timer;
+
+  /* cold fields */
   /** \brief Pointer to the start of the body in buffer */
   char * body;
   /** \brief Length of the body of the request */
   int contentLength;
+  /** \brief The request being received, its views point into \a buffer */
+  struct httpRequest request;
+  /** \brief Bytes of \a fileFd still to be sent, -1 to send up to its end */
+  long fileRemaining;
+  /** \brief Offset in \a fileFd of the next byte to send */
+  long fileOffset;
+  /** \brief Size of the pieces \a fileFd is read in through user space, see \a measureFileReadSize */
+  size_t fileReadSize;
+  /** \brief The cache entry of the requested file, NULL if it is not cached. It owns \a fileFd, which is -1 if the content is in memory */
+  struct cachedFile * cachedFile;
+  /** \brief State of a multipart/byteranges answer, NULL for other answers */
+  struct multipartAnswer * multipart;
+  /** \brief Number of requests received over this connection */
+  int requestCount;
+  /** \brief 1 if the connection is kept open after the current answer */
+  int keepAlive;
+  /** \brief Requests received behind the current one, NULL if there are none */
+  char * pipeline;
+  /** \brief Number of bytes in \a pipeline */
+  unsigned int pipelineLength;
+  /** \brief Physical size of \a pipeline */
+  unsigned int pipelineSize;
+#ifdef HAVE_IO_URING
+  /** \brief The pieces of a gathered io_uring send, see \a gatherAnswer */
+  struct iovec uringParts[2];
+  /** \brief The message of a gathered io_uring send */
+  struct msghdr uringMessage;
+#endif
 };
 
-/** \brief All information extracted by parsing a client request */
-struct parseResult
+/** \brief What the answer from a file depends on, taken from a GET or HEAD request */
+struct fileRequest
 {
-  /** \brief 1 if HTTP Post was used, 0 otherwise. */
-  int post;
-  /** \brief The ContentLength header */
-  int contentLength;
-  /** \brief The requested url. */
-  char url[MAX_URL_SIZE];
-  /** \brief Pointer to the body of the request */
-  char * body;
+  /** \brief The requested file, see \a buildFilePath */
+  char filepath[MAX_FILE_PATH_SIZE];
+  /** \brief 1 for GET, 0 for HEAD */
+  int withBody;
+  /** \brief The If-None-Match header, empty if there is none */
+  char ifNoneMatch[MAX_CONDITION_SIZE];
+  /** \brief The date of the If-Modified-Since header, -1 if there is none */
+  time_t ifModifiedSince;
+  /** \brief The Range header, empty if there is none */
+  char range[MAX_CONDITION_SIZE];
+  /** \brief The If-Range header, empty if there is none */
+  char ifRange[MAX_CONDITION_SIZE];
 };
 
-/** \brief The only open socket at any time (almost). */
-int listeningSocket = -1;
+/** \brief The file system calls a worker thread makes for a connection */
+typedef enum
+{
+  /** \brief Open and load the requested file, which is not cached */
+  fileJobOpen,
+  /** \brief Read the next piece of the file into the buffer */
+  fileJobRead,
+  /** \brief Read the next piece of the file into the page cache, for sendfile */
+  fileJobPrefetch
+} fileJobType;
 
-/**
- * \brief First element of the list of active connections
- */
-struct connectionType * connectionHead = 0;
-/**
- * \brief Last element of the list of active connections
+/** \brief A file system call that may block, made by a worker thread */
+struct fileJob
+{
+  /** \brief The job in the queues of the pool, first so the two convert */
+  struct workerJob job;
+  /** \brief What to do */
+  fileJobType type;
+  /** \brief The connection waiting for the job */
+  struct connectionType * connection;
+  /** \brief The request whose file to open */
+  struct fileRequest request;
+  /** \brief The cache the file is loaded for */
+  const struct fileCache * cache;
+  /** \brief The cache's generation when the job was submitted */
+  unsigned long generation;
+  /** \brief The loaded entry, see \a loadCachedFile */
+  struct cachedFile * file;
+  /** \brief The file to read from, or the one opened, see \a loadCachedFile */
+  int fd;
+  /** \brief Where to read to */
+  char * buffer;
+  /** \brief Size of \a buffer */
+  size_t bufferSize;
+  /** \brief Offset in the file to read from */
+  long offset;
+  /** \brief Number of bytes to read, in pieces of \a bufferSize for a prefetch */
+  long length;
+  /** \brief Result of the read, -1 on errors */
+  long result;
+  /** \brief The errno value of a failed read */
+  int error;
+};
+
+/** \brief Number of event loop threads */
+int threadCount = 1;
+/** \brief Length of the kernel's queue of not yet accepted connections */
+int listenBacklog = SOMAXCONN;
+/** \brief Maximal number of active connections of all loops */
+int maxConnections = MAXCON;
+/** \brief Maximal memory for connections and buffers of all loops in bytes, 0 = unlimited */
+size_t maxMemory = (size_t)DEFAULT_MAX_MEMORY_MB * 1024 * 1024;
+/** \brief Size of the file caches of all loops in bytes, 0 disables caching content */
+size_t fileCacheSize = (size_t)DEFAULT_FILE_CACHE_MB * 1024 * 1024;
+/** \brief Number of files the file caches of all loops keep open, 0 disables caching descriptors */
+int openFiles = DEFAULT_OPEN_FILES;
+/** \brief Time after which a cached file is compared with the file system again (ms, 0 = always) */
+int fileCacheValid = DEFAULT_FILE_CACHE_VALID;
+/** \brief 1 to have changes of the documents reported instead of checking cached files */
+int watchDocuments = 1;
+/** \brief Number of threads that open and read files for the event loops, 0 = none */
+int fileThreads = DEFAULT_FILE_THREADS;
+/** \brief The threads that open and read files, shared by all loops */
+struct workerPool fileWorkers;
+/** \brief What happens to new clients at the limits */
+overloadPolicy overload = overloadReject;
+/** \brief Precomputed answer for clients we have no room for */
+const char serviceUnavailableAnswer[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                        "Retry-After: " RETRY_AFTER_SECONDS "\r\n"
+                                        "Content-Length: 0\r\n"
+                                        "Connection: close\r\n\r\n";
+/** \brief Time a client may take to send the request headers (ms, 0 = forever) */
+int headerTimeout = DEFAULT_HEADER_TIMEOUT;
+/** \brief Time a client may pause while sending a request body (ms, 0 = forever) */
+int bodyTimeout = DEFAULT_BODY_TIMEOUT;
+/** \brief Time a client may stall a response by not reading (ms, 0 = forever) */
+int writeTimeout = DEFAULT_WRITE_TIMEOUT;
+/** \brief Time a chat receiver waits before getting an empty answer (ms, 0 = forever) */
+int longPollTimeout = DEFAULT_LONG_POLL_TIMEOUT;
+/** \brief Time a kept-alive connection may be idle between requests (ms, 0 = forever) */
+int keepAliveTimeout = DEFAULT_KEEP_ALIVE_TIMEOUT;
+/** \brief Number of requests served over one connection, 0 = unlimited */
+int maxRequests = DEFAULT_MAX_REQUESTS;
+/** \brief All event loops, \a threadCount entries, set once their wakeup fds exist */
+struct eventLoop * loops = 0;
+/** \brief Set by the signal handler, the event loops stop at their next round */
+int stopRequested = 0;
+/** \brief Passed by every stopped event loop, none frees what the status report reads before */
+pthread_barrier_t stopBarrier;
+/** \brief The thread rebuilding the snapshot on SIGHUP, if \a preloadDocuments */
+pthread_t reloader;
+/** \brief 1 to answer from a snapshot of the document root loaded at startup */
+int preloadDocuments = 0;
+/** \brief Files that are preloaded besides the document root */
+const char * const preloadedExtras[] = {NOT_FOUND_DOCUMENT, 0};
+/** \brief The latest snapshot of the document root, guarded by \a snapshotLock */
+struct snapshot * currentSnapshot = 0;
+/** \brief Number of snapshots installed so far, changes when \a currentSnapshot does */
+unsigned int snapshotGeneration = 0;
+/** \brief Guards the exchange of \a currentSnapshot */
+pthread_mutex_t snapshotLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Everything below up to the logs belongs to a single event loop
+ * and is therefore thread local.
  */
-struct connectionType * connectionTail = 0;
+
+/** \brief The only open socket at any time (almost). */
+__thread int listeningSocket = -1;
+/** \brief eventfd that wakes this loop up */
+__thread int wakeupFd = -1;
+/** \brief The loop running in this thread */
+__thread struct eventLoop * currentLoop;
+
 /**
  * \brief Poll struct array
  *
  * At any time the first part is full, the rest is null.
  */
-struct pollfd * pollStruct;
+__thread struct pollfd * pollStruct;
+/**
+ * \brief The active connections, indexed in lockstep with \a pollStruct
+ *
+ * The first \a RESERVED_POLL_SLOTS entries are unused. Closing a connection
+ * moves the last one into its slot, so the table stays dense.
+ */
+__thread struct connectionType ** connectionTable;
+/** \brief Allocator for the connection objects */
+__thread struct objectPool connectionPool;
+/** \brief Allocator for the connection buffers */
+__thread struct bufferPool bufferPool;
+/** \brief Deadlines of all connections */
+__thread struct timerWheel timerWheel;
+/** \brief This loop's share of \a maxConnections */
+__thread int loopMaxConnections;
+/** \brief This loop's share of \a maxMemory, 0 = unlimited */
+__thread size_t loopMaxMemory;
+/** \brief Number of open connections of this loop */
+__thread int connectionCount;
+/** \brief Set while the listening socket is not watched because of overload */
+__thread int acceptPaused;
+/** \brief Set while the multishot accept of io_uring is in flight */
+__thread int uringAcceptActive;
+/** \brief Load shedding counters */
+__thread struct sheddingStats sheddingStats;
+/** \brief The files this loop serves from memory */
+__thread struct fileCache fileCache;
+/** \brief The snapshot this loop answers from when preloading, the loop holds a reference */
+__thread struct snapshot * loopSnapshot;
+/** \brief The \a snapshotGeneration of \a loopSnapshot */
+__thread unsigned int loopSnapshotGeneration;
+#ifdef HAVE_INOTIFY
+/** \brief Reports changes of the files this loop caches */
+__thread struct directoryWatch directoryWatch = {-1, 0, 0, 0, 0, 0};
+#endif
+/** \brief The connection whose answer \a handleBufferedInput prepared last */
+__thread struct connectionType * preparedAnswer;
+/** \brief File jobs of this loop the workers are done with, signalled on \a wakeupFd */
+__thread struct completionQueue fileJobCompletions;
+/** \brief The file a worker opened for the answer being prepared, taken by \a openAnswerFile */
+__thread struct fileJob * openedFile;
+/** \brief The second \a httpDate shows */
+__thread time_t httpDateSeconds = -1;
+/** \brief The current time in HTTP format, see \a currentHttpDate */
+__thread char httpDate[FILE_DATE_SIZE];
+/** \brief Time the loop last woke up (ms, monotonic) */
+__thread unsigned long loopTime;
 /** \brief Size of the \a pollStruct array */
-int pollStructSize;
+__thread int pollStructSize;
 /** \brief First free index in \a pollStruct that can be filled by newly accepted connections. */
-int nextFreePollStructIndex = 1;
+__thread int nextFreePollStructIndex = RESERVED_POLL_SLOTS;
 
-/** \brief The server's access log */
+/** \brief The event backend used by the main loop */
+#ifdef HAVE_EPOLL
+backendType eventBackend = backendEpoll;
+#else
+backendType eventBackend = backendPoll;
+#endif
+/** \brief The epoll instance if \a eventBackend is \a backendEpoll, -1 otherwise */
+__thread int epollFd = -1;
+#ifdef HAVE_IO_URING
+/** \brief The io_uring instance if \a eventBackend is \a backendUring */
+__thread struct uring ring;
+/** \brief Target of the io_uring read on \a wakeupFd */
+__thread __u64 wakeupCount;
+#endif
+
+/** \brief The server's access log (shared by all loops) */
 struct log * accessLog = 0;
-/** \brief The server's error log */
+/** \brief The server's error log (shared by all loops) */
 struct log * errorLog = 0;
 
-/**
- * Frees allocated ressources on exiting the program.
- * Is to be registered as a callback using atexit.
- */
-void cleanUpOnExit()
-{
-  /* try to close the socket if necessary */
-  if (listeningSocket != -1)
-  {
-  #ifdef DEBUG
-    puts("Closing Socket on Exit.");
-  #endif
-    int result = close(listeningSocket);
-    if (result == -1)
-      perror("Error closing Socket");
-  }
-  struct connectionType * conIt = connectionHead;
-  while (conIt != 0)
-  {
-    free(conIt->prev); /* free(0) does nothing */
-    assert(conIt->status != statusClosed); /* closed connections are not in our list */
-    close (conIt->socketFd);
-    free(conIt->buffer);
-    if (conIt->fileFd!=-1)
-      close(conIt->fileFd);
-    conIt = conIt->next;
-  }
-  free(connectionTail);
-  free(pollStruct);
-  freeLog(accessLog);
-  freeLog(errorLog);
-  fflush(stdout);
-}
-
 /**
  * Checks the return value \a result and prints the last error message if it
  * indicates errors.
@@ -183,527 +544,2982 @@ void exitIfError(int result, char * errorMessage)
 }
 
 /**
- * Resizes the poll struct
+ * Resizes the poll struct and the connection table along with it
  */
 void resizePollStruct(short int increaseSize)
 {
 #ifdef DEBUG
   puts("Resizing poll struct");
 #endif
-  /* nextFreePollStructIndex - 1 = # active connections */
-  /* 2 = listening socket + 0-Vector
+  /* nextFreePollStructIndex - RESERVED_POLL_SLOTS = # active connections */
+  /* RESERVED_POLL_SLOTS + 1 = listening socket + wakeup fd + directory watch + 0-Vector
    * 1 = new overflow connection that caused the rebuild */
-  int newPollStructSize = nextFreePollStructIndex - 1 + 2 + (increaseSize?1:0)+ INITIAL_FREE_SLOTS_IN_POLLSTRUCT;
+  int newPollStructSize = nextFreePollStructIndex - RESERVED_POLL_SLOTS + RESERVED_POLL_SLOTS + 1 + (increaseSize?1:0)+ INITIAL_FREE_SLOTS_IN_POLLSTRUCT;
   struct pollfd * newStruct = realloc(pollStruct, newPollStructSize * sizeof(struct pollfd));
   if (newStruct == NULL)
   {
     fputs("Could not allocate new space for pollstruct", stderr);
     exit(1);
   }
+  pollStruct = newStruct;
+  struct connectionType ** newTable = realloc(connectionTable, newPollStructSize * sizeof(struct connectionType *));
+  if (newTable == NULL)
+  {
+    fputs("Could not allocate new space for connection table", stderr);
+    exit(1);
+  }
+  connectionTable = newTable;
   /* null the newly allocated space */
   if (increaseSize)
-    memset(newStruct + pollStructSize, 0, sizeof(struct pollfd) * (newPollStructSize - pollStructSize));
-  pollStruct = newStruct;
+  {
+    memset(pollStruct + pollStructSize, 0, sizeof(struct pollfd) * (newPollStructSize - pollStructSize));
+    memset(connectionTable + pollStructSize, 0, sizeof(struct connectionType *) * (newPollStructSize - pollStructSize));
+  }
   pollStructSize = newPollStructSize;
 }
 
 /**
- * Closes a given connection.
- * \param connection The connection to close.
+ * Determines how much of the file to read into the buffer next.
+ * \param connection The connection that sends a file.
+ * \returns The number of bytes to read.
  */
-void closeConnection(struct connectionType * const connection)
+unsigned int fileChunkSize(const struct connectionType * const connection)
 {
-#ifdef DEBUG
-  puts("Closing connection");
-#endif
-  /* detach from list */
-  if (connection->prev == 0)
-  {
-    assert(connectionHead == connection);
-    connectionHead = connection->next;
-  }
-  else
-    connection->prev->next = connection->next;
-
-  if (connection->next == 0)
-  {
-    assert(connectionTail == connection);
-    connectionTail = connection->prev;
-  }
-  else
-    connection->next->prev = connection->prev;
+  unsigned int size = connection->bufferSize;
+  if (connection->fileRemaining >= 0 && connection->fileRemaining < size)
+    size = connection->fileRemaining;
+  return size;
+}
 
-  /* close fds */
-  if (close(connection->socketFd) == -1)
-    fputs("Error closing socket", stderr);
-  connection->socketFd = -1;
-  if (connection->fileFd!=-1 && close(connection->fileFd) == -1)
-    fputs("Error closing file", stderr);
-  /* free buffer */
-  free(connection->buffer);
+/**
+ * Computes how much of a cached file to send at once.
+ * \param connection The connection sending from the file cache.
+ * \returns The number of bytes.
+ */
+unsigned int cachedChunkSize(const struct connectionType * const connection)
+{
+  return connection->fileRemaining < SENDFILE_CHUNK_SIZE ? connection->fileRemaining
+                                                         : SENDFILE_CHUNK_SIZE;
+}
 
-  /* swap last poll entry to this position */
-  if (connection->pollStructIndex != nextFreePollStructIndex-1)
-  {
-    /* TODO dammit we get O(n) time here */
-    /* find last entry in poll struct */
-    struct connectionType * conIt = connectionTail;
-    while (conIt != 0)
-    {
-      if (conIt->pollStructIndex == nextFreePollStructIndex-1)
-        break;
-      conIt = conIt->prev;
-    }
-    assert(conIt->pollStructIndex == nextFreePollStructIndex-1);
-    /* copy it to our position */
-    memcpy(pollStruct + connection->pollStructIndex,
-           pollStruct + conIt->pollStructIndex,
-           sizeof(struct pollfd));
-    /* adapt connection struct */
-    conIt->pollStructIndex = connection->pollStructIndex;
-  }
-  /* clean the old position */
-  --nextFreePollStructIndex;
-  memset(pollStruct + nextFreePollStructIndex, 0, sizeof(struct pollfd));
-  free(connection);
-  /* downsize poll struct if necessary */
-  /* nextFreePollStructIndex - 1 = #connections */
-  /* 2 = 0-Vector + listening socket */
-  if (nextFreePollStructIndex - 1 + 2 + FREE_SLOTS_TO_DOWNSIZE_POLLSTRUCT < pollStructSize)
-    resizePollStruct(0);
+/**
+ * Checks whether the current answer has a file to send from.
+ * \param connection The connection to check.
+ * \returns 1 if there is an open or cached file, 0 otherwise.
+ */
+int hasFile(const struct connectionType * const connection)
+{
+  return connection->fileFd != -1 || connection->cachedFile != NULL;
 }
 
 /**
- * Stores the headers for the given \a statusCode in the buffer
- * \param connection Connection in whose buffer the headers are stored.
- * \param statusCode HTTP status code that determines the headers.
+ * Checks whether the current answer is sent from a file held in memory.
+ * \param connection The connection to check.
+ * \returns 1 if the file's content is in the file cache, 0 otherwise.
  */
-void bufferHeaders(struct connectionType * connection, int statusCode)
+int fileInMemory(const struct connectionType * const connection)
 {
-int offset;
-  switch (statusCode)
-  {
-    case 200:
-    {
-      const char statusCodeString[] = "HTTP/1.0 200 OK\r\n";
-      time_t currentSeconds = time (NULL);
-      struct tm * currentGMT = gmtime(&currentSeconds);
-      char dateMessage[40];
-      if (strftime(dateMessage, 40, "Date: %a, %d %b %Y %H:%M:%S %Z\r\n", currentGMT)==0)
-      {
-        fputs("Error creating dateMessage", stderr);
-        exit(1);
-      }
+  return connection->fileFd == -1 && connection->cachedFile != NULL;
+}
 
-      if (strlen(dateMessage) + strlen(statusCodeString) + 3 > connection->bufferSize)
-      {
-        fputs("Error: Buffer too small for HTTP answer 200", stderr);
-        exit(1);
-      }
-      strcpy(connection->buffer, statusCodeString);
-      offset = strlen(statusCodeString);
-      strcpy(connection->buffer + offset, dateMessage);
-      offset = strlen(connection->buffer);
-      break;
-    }
-    case 404:
-    {
-    #ifdef DEBUG
-    puts("Buffering 404 headers");
-    #endif
-      const char statusCodeString[] = "HTTP/1.0 404 Not Found\r\n";
-      if (strlen(statusCodeString) + 3 > connection->bufferSize)
-      {
-        fputs("Error: Buffer too small for HTTP answer 404", stderr);
-        exit(1);
-      }
-      strcpy(connection->buffer, statusCodeString);
-      offset = strlen(connection->buffer);
-      break;
-    }
-    default:
-       return;
-  }
-  strcpy(connection->buffer + offset, "\r\n");
-  connection->bufferLength = strlen(connection->buffer);
-  connection->bufferFreeOffset = 0;
+/**
+ * Closes the connection's file or hands it back to the file cache.
+ * \param connection The connection whose file is not needed any more.
+ */
+void closeFile(struct connectionType * const connection)
+{
+  if (connection->cachedFile != NULL)
+    releaseCachedFile(connection->cachedFile);
+  else if (connection->fileFd != -1 && close(connection->fileFd) == -1)
+    fputs("Error closing file", stderr);
+  connection->fileFd = -1;
+  connection->cachedFile = NULL;
 }
 
 /**
- * Send the content of a buffer through the network.
- * \param connection The connection whose buffer and network
- * socket are to be used.
+ * Determines the size of the pieces a file is read in through user space
+ * once its answer starts. The send buffer of the socket is no guide, the
+ * kernel grows it while the answer is sent, so large files are read in the
+ * largest pieces and small ones in one piece.
+ * \param connection The connection that starts sending a file.
  */
-void sendBuffer(struct connectionType * const connection)
+void measureFileReadSize(struct connectionType * const connection)
 {
-  const char * toSend = connection->buffer + connection->bufferFreeOffset;
-  int len = connection->bufferLength - connection->bufferFreeOffset;
-  int sent = write(connection->socketFd, toSend, len);
-  exitIfError(sent, "Error writing to socket");
-  if (sent == 0)
-  {
-    if (len == 0)
-      fputs("Error: Send buffer was empty", stderr);
-    else
-      fputs("Error: Nothing was sent", stderr);
-    exit(1);
-  }
-  connection->bufferFreeOffset+=sent;
+  connection->fileReadSize = FILE_READ_MAX_SIZE;
+  if (connection->fileRemaining > 0 && connection->fileRemaining < FILE_READ_MAX_SIZE)
+    connection->fileReadSize = connection->fileRemaining;
 }
 
 /**
- * Sends the next piece of information over the network
- * \param connection The connection over which the information is to be sent
+ * Replaces the drained buffer of a connection by one of \a fileReadSize,
+ * but not larger than what is left of the file, so a file is read in large
+ * pieces. Within the memory limit only, the old buffer stays otherwise.
+ * \param connection The connection about to read from its file.
  */
-void sendConnection(struct connectionType * const connection)
+void provideFileBuffer(struct connectionType * const connection)
 {
-  /*
-   * expect that there is something in the buffer to send
-   * either filled by bufferHeaders or by last call to sendConnection
-   */
-  assert(connection->bufferFreeOffset < connection->bufferLength);
-  sendBuffer(connection);
-  if (connection->bufferFreeOffset == connection->bufferLength)
-  {
-    if (connection->fileFd == -1)
-      closeConnection(connection);
-    else
-    {
-      /* fill buffer from file */
-      int len = read(connection->fileFd, connection->buffer, connection->bufferSize-1);
-      exitIfError(len,"Error reading from file");
-      if (len > 0)
-      {
-        connection->bufferFreeOffset = 0;
-        connection->bufferLength = len;
-      }
-      else /* eof */
-        closeConnection(connection);
-    }
-  }
+  size_t size = connection->fileReadSize;
+  if (connection->fileRemaining >= 0 && (size_t)connection->fileRemaining < size)
+    size = connection->fileRemaining;
+  size = bufferClassSize(size);
+  if (size <= connection->bufferSize
+      || (loopMaxMemory > 0
+          && connectionPool.stats.usedBytes + bufferPool.stats.usedBytes + size > loopMaxMemory))
+    return;
+  char * buffer = allocBuffer(&bufferPool, size);
+  if (buffer == NULL)
+    return;
+  releaseBuffer(&bufferPool, connection->buffer, connection->bufferSize);
+  connection->buffer = buffer;
+  connection->bufferSize = size;
 }
 
 /**
- * Parses a HTTP request and extracts interesting information.
- * \param buffer Contains the HTTP request.
- * \returns The results of parsing the request.
+ * Gives a connection that read its file in large pieces its default buffer
+ * back once the answer is complete.
+ * \param connection The connection, its buffer is empty.
  */
-struct parseResult parseRequest(char* buffer)
+void shrinkFileBuffer(struct connectionType * const connection)
 {
-  struct parseResult result;
-  result.post = 0;
-  const char delimiters[] = "\r\n";
-  const char clHeader[] = "Content-Length: ";
-  const int clLength=strlen(clHeader);
-  /* save the body from strtok*/
-  char * bodyDelim = strstr(buffer, "\r\n\r\n");
-  result.body = bodyDelim + 4;
-  bodyDelim[0]='\0';
-  char * tokenStart = strtok(buffer, delimiters);
-  while (tokenStart != 0)
-  {
-#ifdef DEBUG
-    /*puts(tokenStart);*/
-#endif
-    if (strncmp(tokenStart, "GET", 3) == 0)
-    {
-      tokenStart+=4;
-      const char* urlEnd = strchr(tokenStart, ' ');
-      if (urlEnd == 0)
-      {
-        fprintf(stderr, "Error: Format of the GET header is invalid.");
-        exit(1);
-      }
-      int urlLength = min(sizeof(result.url)-1, urlEnd - tokenStart);
-      strncpy(result.url, tokenStart, urlLength);
-      result.url[urlLength] = '\0';
-    }
-    if (strncmp(tokenStart, "POST /broadcast.service", strlen("POST /broadcast.service")) == 0)
-    {
-      result.post = 1;
-    }
-    if (result.post && strncmp(tokenStart, clHeader, clLength) == 0)
-    {
-      tokenStart+=clLength;
-      result.contentLength = atoi(tokenStart);
-#ifdef DEBUG
-      puts("Chat Server Request");
-      printf("CL: %d\n", result.contentLength);
-#endif
-      /* no more headers are interesting, find body and return result */
-      return result;
-    }
-    tokenStart  = strtok((char *)0, delimiters);
-  }
-  return result;
+  if (connection->bufferSize < FILE_READ_MIN_SIZE)
+    return;
+  char * buffer = allocBuffer(&bufferPool, BUFFER_SIZE);
+  if (buffer == NULL)
+    return;
+  releaseBuffer(&bufferPool, connection->buffer, connection->bufferSize);
+  connection->buffer = buffer;
+  connection->bufferSize = bufferClassSize(BUFFER_SIZE);
 }
 
+/**
+ * Asks the kernel to read the next piece of the connection's file ahead,
+ * while the current one is still being sent.
+ * \param connection The connection sending a file from disk.
+ * \param size Size of the piece.
+ */
+void prefetchFileChunk(const struct connectionType * const connection, long size)
+{
+  if (connection->fileRemaining == 0)
+    return;
+  if (connection->fileRemaining > 0 && connection->fileRemaining < size)
+    size = connection->fileRemaining;
+  posix_fadvise(connection->fileFd, connection->fileOffset, size, POSIX_FADV_WILLNEED);
+}
 
 /**
- * Receive a string message through a socket.
- * \param sock Socket descriptor for the socket to receive the message through.
- * \param buffer Buffer for buffering the message we receive.
- * \param size Size of the \a buffer.
+ * Prepares reading a file about to be sent from disk: determines the size
+ * of its pieces and tells the kernel how it is read, large ones
+ * sequentially, so it reads ahead further, starting with the first piece.
+ * \param connection The connection whose answer starts.
  */
-int receiveMessage(int sock, char* buffer, int size)
+void adviseFileReads(struct connectionType * const connection)
 {
-  int len = read(sock, buffer, size);
-  exitIfError(len,"Error reading from socket");
-  return len;
+  if (connection->fileFd == -1)
+    return;
+  /* the parts of a multipart answer may all follow later */
+  measureFileReadSize(connection);
+  if (connection->fileRemaining == 0
+      || (connection->fileRemaining > 0 && connection->fileRemaining <= FILE_READ_MIN_SIZE))
+    return;
+  posix_fadvise(connection->fileFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  prefetchFileChunk(connection, FILE_READ_MAX_SIZE);
 }
 
 /**
- * Appends a message to the chat log
- * \param message The message to append.
- * \param length The length of the message.
+ * Collects what goes out next in one piece: the rest of the buffer and,
+ * right behind it, the next piece of the file if its content is in memory.
+ * So the headers share their packets with the content.
+ * \param connection The connection sending an answer.
+ * \param parts Receives the pieces, room for two.
+ * \returns The number of pieces.
  */
-void appendToChatLog(char * message, int length)
+int gatherAnswer(const struct connectionType * const connection, struct iovec * parts)
 {
-  int file = open(CHATLOGFILE, O_WRONLY | O_APPEND);
-  assert(file != -1);
-  write(file, message, length);
-  close(file);
+  parts[0].iov_base = connection->buffer + connection->bufferFreeOffset;
+  parts[0].iov_len = connection->bufferLength - connection->bufferFreeOffset;
+  if (!fileInMemory(connection) || connection->fileRemaining <= 0)
+    return 1;
+  parts[1].iov_base = connection->cachedFile->data + connection->fileOffset;
+  parts[1].iov_len = cachedChunkSize(connection);
+  return 2;
 }
 
 /**
- * Prints the message to the chat log and closes the connection if
- * the currently received body is long enough to include the
- * complete chat message. Afterwards distributes the message to all clients.
- * \param connection The connection to check.
+ * Accounts for bytes sent of the pieces collected by \a gatherAnswer.
+ * \param connection The connection that sent them.
+ * \param sent The number of bytes sent.
  */
-void checkChatMessageComplete(struct connectionType * const connection)
+void advanceAnswer(struct connectionType * const connection, size_t sent)
 {
-  if (connection->body + connection->contentLength
-      <= connection->buffer + connection->bufferFreeOffset)
+  size_t buffered = connection->bufferLength - connection->bufferFreeOffset;
+  if (sent <= buffered)
   {
-    appendToChatLog(connection->body, connection->contentLength);
-    closeConnection(connection);
-    /* distribute new message */
-    struct connectionType * conIt = connectionHead;
-    while (conIt != NULL)
-    {
-      if (conIt->status == statusChatReceiver)
-      {
-        bufferHeaders(conIt, 200);
-        conIt->fileFd = open(CHATLOGFILE, O_RDONLY);
-        assert(conIt->fileFd != -1);
-        assert(conIt->fileFd != 0);
-        conIt->status = statusOutgoingAnswer;
-        pollStruct[conIt->pollStructIndex].events = POLLOUT;
-      }
-      conIt = conIt->next;
-    }
+    connection->bufferFreeOffset += sent;
+    return;
   }
+  connection->bufferFreeOffset = connection->bufferLength;
+  connection->fileOffset += sent - buffered;
+  connection->fileRemaining -= sent - buffered;
 }
 
+#ifdef HAVE_EPOLL
 /**
- * Read from a given connection and initialize resulting actions.
- * \param connection The connection to read from
+ * Registers or updates a file descriptor with the epoll instance.
+ * The interest set is given in poll notation and always edge-triggered.
+ * \param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * \param fd The file descriptor to watch.
+ * \param events The poll events (POLLIN, POLLOUT) of interest.
+ * \param connection The connection to report for this fd, 0 for the listening socket.
  */
-void receiveConnection(struct connectionType * const connection)
+void updateEpoll(int op, int fd, short events, struct connectionType * connection)
 {
-  /* increase buffer size if necessary */
-  if (connection->bufferFreeOffset == connection->bufferSize)
-  {
-    if (connection->bufferSize >= MAX_BUFFER_SIZE)
-    {
-      closeConnection(connection);
-      return;
-    }
-    char * newSpace=realloc(connection->buffer, connection->bufferSize * 2);
-    if (newSpace == NULL)
-    {
-      closeConnection(connection);
-      return;
-    }
-    memset(newSpace + connection->bufferSize, 0, connection->bufferSize);
-    connection->bufferSize*=2;
-    connection->buffer = newSpace;
-  }
-  /* receive Message */
-  int length = receiveMessage(connection->socketFd, connection->buffer + connection->bufferFreeOffset, connection->bufferSize - connection->bufferFreeOffset);
-  if (length == 0)
-  {
-#ifdef DEBUG
-    puts("Connection closed by client");
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLET;
+  if (events & POLLIN)
+    event.events |= EPOLLIN;
+  if (events & POLLOUT)
+    event.events |= EPOLLOUT;
+  event.data.ptr = connection;
+  exitIfError(epoll_ctl(epollFd, op, fd, &event), "Error updating epoll set");
+}
 #endif
-    closeConnection(connection);
+
+#ifdef HAVE_IO_URING
+/**
+ * Queues the next io_uring operation for a connection. It is submitted
+ * together with all others queued in the same loop iteration.
+ * \param connection The connection to operate on, 0 for the listening socket.
+ * \param op The operation to queue.
+ */
+void queueUringOperation(struct connectionType * const connection, uringOpType op)
+{
+  struct io_uring_sqe * sqe = getUringSqe(&ring);
+  if (sqe == 0)
+  {
+    perror("Error queueing io_uring operation");
+    exit(1);
   }
-  else
+  switch (op)
   {
-    connection->bufferFreeOffset += length;
-    connection->buffer[connection->bufferFreeOffset]='\0';
-    if (connection->status == statusIncomingRequest && 0!=strstr(connection->buffer, "\r\n\r\n"))
-    {
-      struct parseResult result = parseRequest(connection->buffer);
-      if (!result.post)
+    case uringAccept:
+      /* one submission keeps delivering new clients */
+      uringAcceptActive = 1;
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->fd = listeningSocket;
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      sqe->accept_flags = SOCK_CLOEXEC;
+      break;
+    case uringRecv:
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = connection->socketFd;
+      sqe->addr = (unsigned long)(connection->buffer + connection->bufferFreeOffset);
+      sqe->len = connection->bufferSize - connection->bufferFreeOffset - 1; /* keep space for '\0' */
+      break;
+    case uringSend:
+      sqe->fd = connection->socketFd;
+      /* the socket may be shut down under a deferred close */
+      sqe->msg_flags = MSG_NOSIGNAL;
+      memset(&connection->uringMessage, 0, sizeof(struct msghdr));
+      connection->uringMessage.msg_iov = connection->uringParts;
+      connection->uringMessage.msg_iovlen = gatherAnswer(connection, connection->uringParts);
+      if (connection->uringMessage.msg_iovlen == 1)
       {
-        /* normal file requested */
-        char filepath[MAX_FILE_PATH_SIZE];
-        memset(filepath, 0, sizeof(filepath));
-        strncpy(filepath, documentRoot, strlen(documentRoot));
-        strncpy(filepath + strlen(documentRoot), result.url, strlen(result.url));
-#ifdef DEBUG
-        puts(result.url);
-        puts(filepath);
-#endif
-        connection->fileFd = open(filepath, O_RDONLY);
-        /* buffer correct headers */
-        if (connection->fileFd == -1)
-        {
-          doLog(errorLog, "GET %s 404 Not Found", result.url);
-          bufferHeaders(connection, 404);
-          connection->fileFd = open("./error_documents/404.html", O_RDONLY);
-        }
-        else
-        {
-          doLog(accessLog, "GET %s 200 OK", result.url);
-          bufferHeaders(connection, 200);
-        }
-        /* prepare connection for sending */
-        connection->status = statusOutgoingAnswer;
-        pollStruct[connection->pollStructIndex].events = POLLOUT;
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr = (unsigned long)connection->uringParts[0].iov_base;
+        sqe->len = connection->uringParts[0].iov_len;
+      }
+      else
+      {
+        /* the file in memory goes out behind the buffer */
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = (unsigned long)&connection->uringMessage;
+        sqe->len = 1;
+      }
+      break;
+    case uringSendCached:
+      sqe->opcode = IORING_OP_SEND;
+      sqe->fd = connection->socketFd;
+      sqe->addr = (unsigned long)(connection->cachedFile->data + connection->fileOffset);
+      sqe->len = cachedChunkSize(connection);
+      sqe->msg_flags = MSG_NOSIGNAL;
+      break;
+    case uringRead:
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = connection->fileFd;
+      sqe->addr = (unsigned long)connection->buffer;
+      sqe->len = fileChunkSize(connection);
+      sqe->off = connection->fileOffset;
+      break;
+    case uringWatch:
+      /* parked connection: notice when the client goes away; without one: changes of the documents */
+      sqe->opcode = IORING_OP_POLL_ADD;
+#ifdef HAVE_INOTIFY
+      sqe->fd = connection != 0 ? connection->socketFd : directoryWatch.fd;
+#else
+      sqe->fd = connection->socketFd;
+#endif
+      sqe->poll32_events = POLLIN;
+      break;
+    case uringWakeup:
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = wakeupFd;
+      sqe->addr = (unsigned long)&wakeupCount;
+      sqe->len = sizeof(wakeupCount);
+      break;
+    case uringCancel:
+      /* ends the multishot accept (see pauseAccepting) or the watch of a woken chat receiver */
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->fd = -1;
+      sqe->addr = connection != 0 ? (unsigned long)connection | uringWatch : uringAccept; /* its user_data */
+      break;
+  }
+  sqe->user_data = (unsigned long)connection | op;
+  if (connection != 0)
+    ++connection->pendingOps;
+}
+#endif
+
+/**
+ * Reads the monotonic clock.
+ * \returns The current time in milliseconds.
+ */
+unsigned long currentTimeMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000UL + now.tv_nsec / 1000000;
+}
+
+/**
+ * (Re)starts the deadline that belongs to the current status of a connection.
+ * \param connection The connection to watch.
+ */
+void armConnectionTimer(struct connectionType * const connection)
+{
+  int timeout = 0;
+  switch (connection->status)
+  {
+    case statusIncomingRequest:
+      /* between two requests of a kept-alive connection */
+      if (connection->requestCount > 0 && connection->bufferFreeOffset == 0)
+        timeout = keepAliveTimeout;
+      /* the head is complete, the body of a file request is being skipped */
+      else if (connection->request.length > 0)
+        timeout = bodyTimeout;
+      else
+        timeout = headerTimeout;
+      break;
+    case statusChatSender:
+      timeout = bodyTimeout;
+      break;
+    case statusOutgoingAnswer:
+      timeout = writeTimeout;
+      break;
+    case statusChatReceiver:
+      timeout = longPollTimeout;
+      break;
+    default:
+      break;
+  }
+  if (timeout > 0)
+    addTimer(&timerWheel, &connection->timer, loopTime + timeout);
+  else
+    removeTimer(&timerWheel, &connection->timer);
+}
+
+/**
+ * Sets the events we are interested in for a given connection.
+ * With io_uring this queues the matching operation instead.
+ * \param connection The connection to watch.
+ * \param events The poll events (POLLIN, POLLOUT) of interest, 0 to park it.
+ */
+void setConnectionEvents(struct connectionType * const connection, short events)
+{
+  pollStruct[connection->pollStructIndex].events = events;
+  /* the status changed along with the events */
+  armConnectionTimer(connection);
+#ifdef HAVE_EPOLL
+  if (eventBackend == backendEpoll)
+    updateEpoll(EPOLL_CTL_MOD, connection->socketFd, events, connection);
+#endif
+#ifdef HAVE_IO_URING
+  if (eventBackend == backendUring)
+  {
+    /* an answer from the cache may have nothing in the buffer */
+    if ((events & POLLOUT) && fileInMemory(connection)
+        && connection->bufferFreeOffset == connection->bufferLength)
+      queueUringOperation(connection, uringSendCached);
+    else if (events & POLLOUT)
+      queueUringOperation(connection, uringSend);
+    else if (events & POLLIN)
+      queueUringOperation(connection, uringRecv);
+    else
+      queueUringOperation(connection, uringWatch);
+  }
+#endif
+}
+
+/**
+ * Stops watching a parked chat receiver that is woken up. Under io_uring its
+ * watch would otherwise stay armed and fire on the next request of the
+ * kept-alive connection, the other backends replace the events anyway.
+ * \param connection The chat receiver.
+ */
+void unparkConnection(struct connectionType * const connection)
+{
+#ifdef HAVE_IO_URING
+  if (eventBackend == backendUring)
+    queueUringOperation(connection, uringCancel);
+#else
+  (void)connection;
+#endif
+}
+
+/**
+ * Closes the file descriptors of a detached connection and frees it.
+ * \param connection The connection to release.
+ */
+void releaseConnection(struct connectionType * const connection)
+{
+  STATS_SUB(connectionCount, 1);
+  /* close fds (this also removes the socket from the epoll set) */
+  if (close(connection->socketFd) == -1)
+    fputs("Error closing socket", stderr);
+  connection->socketFd = -1;
+  closeFile(connection);
+  /* return memory to the pools */
+  releaseBuffer(&bufferPool, connection->buffer, connection->bufferSize);
+  if (connection->pipeline != NULL)
+    releaseBuffer(&bufferPool, connection->pipeline, connection->pipelineSize);
+  releaseBuffer(&bufferPool, (char *)connection->multipart, sizeof(struct multipartAnswer));
+  freeObject(&connectionPool, connection);
+}
+
+/**
+ * Gives a connection without buffer a fresh one of default size.
+ * \param connection The connection that needs a buffer.
+ * \returns 1 on success, 0 if no memory is left.
+ */
+int attachBuffer(struct connectionType * const connection)
+{
+  assert(connection->buffer == NULL);
+  connection->buffer = allocBuffer(&bufferPool, BUFFER_SIZE);
+  if (connection->buffer == NULL)
+    return 0;
+  connection->bufferSize = bufferClassSize(BUFFER_SIZE);
+  connection->bufferFreeOffset = 0;
+  connection->bufferLength = 0;
+  return 1;
+}
+
+/**
+ * Returns the buffer of an idle connection to the pool.
+ * \param connection The connection that does not need its buffer for now.
+ */
+void detachBuffer(struct connectionType * const connection)
+{
+  releaseBuffer(&bufferPool, connection->buffer, connection->bufferSize);
+  connection->buffer = NULL;
+  connection->bufferSize = 0;
+  connection->bufferFreeOffset = 0;
+  connection->bufferLength = 0;
+  connection->body = NULL;
+}
+
+/**
+ * Closes a given connection.
+ * \param connection The connection to close.
+ */
+void closeConnection(struct connectionType * const connection)
+{
+#ifdef DEBUG
+  puts("Closing connection");
+#endif
+  assert(connectionTable[connection->pollStructIndex] == connection);
+  removeTimer(&timerWheel, &connection->timer);
+  /* swap last poll entry and its connection to this position */
+  int last = nextFreePollStructIndex - 1;
+  if (connection->pollStructIndex != last)
+  {
+    struct connectionType * lastConnection = connectionTable[last];
+    /* copy it to our position */
+    memcpy(pollStruct + connection->pollStructIndex,
+           pollStruct + last,
+           sizeof(struct pollfd));
+    connectionTable[connection->pollStructIndex] = lastConnection;
+    /* adapt connection struct */
+    lastConnection->pollStructIndex = connection->pollStructIndex;
+  }
+  /* clean the old position */
+  --nextFreePollStructIndex;
+  memset(pollStruct + nextFreePollStructIndex, 0, sizeof(struct pollfd));
+  connectionTable[nextFreePollStructIndex] = 0;
+  if (connection->pendingOps > 0)
+  {
+    /* io_uring or a worker still uses the buffer, free it once the last operation completed */
+    connection->status = statusClosed;
+#ifdef HAVE_EPOLL
+    /* the socket stays open until then, its events are of no interest */
+    if (eventBackend == backendEpoll)
+      updateEpoll(EPOLL_CTL_DEL, connection->socketFd, 0, 0);
+#endif
+    shutdown(connection->socketFd, SHUT_RDWR);
+  }
+  else
+    releaseConnection(connection);
+  /* downsize poll struct if necessary */
+  /* nextFreePollStructIndex - RESERVED_POLL_SLOTS = #connections */
+  /* RESERVED_POLL_SLOTS + 1 = 0-Vector + listening socket + wakeup fd + directory watch */
+  if (nextFreePollStructIndex - RESERVED_POLL_SLOTS + RESERVED_POLL_SLOTS + 1 + FREE_SLOTS_TO_DOWNSIZE_POLLSTRUCT < pollStructSize)
+    resizePollStruct(0);
+}
+
+/**
+ * Closes a connection after a hard error on it, all other connections carry on.
+ * \param connection The failed connection.
+ * \param action What failed, for the error log.
+ * \param error The errno value describing the failure.
+ */
+void abortConnection(struct connectionType * const connection, const char * action, int error)
+{
+  doLog(errorLog, "Error %s: %s, closing connection", action, strerror(error));
+  closeConnection(connection);
+}
+
+/**
+ * Parses a date as used in HTTP headers, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ * \param text The date, not necessarily terminated by '\\0'.
+ * \param length Length of \a text.
+ * \returns The date in seconds since the epoch, -1 if it is invalid.
+ */
+time_t parseHttpDate(const char * text, unsigned int length)
+{
+  char date[40];
+  if (length >= sizeof(date))
+    return -1;
+  memcpy(date, text, length);
+  date[length] = '\0';
+  struct tm dateGMT;
+  memset(&dateGMT, 0, sizeof(dateGMT));
+  const char * end = strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &dateGMT);
+  if (end == NULL || *end != '\0')
+    return -1;
+  return timegm(&dateGMT);
+}
+
+/**
+ * Checks whether the client's copy of a file is still current. Entity tags
+ * are compared weakly, as RFC 7232 demands for If-None-Match, and
+ * If-Modified-Since only counts without If-None-Match.
+ * \param request The conditions of the request.
+ * \param file The file's status and validators, see \a describeFile.
+ * \returns 1 if the file was not modified, 0 otherwise.
+ */
+int fileNotModified(const struct fileRequest * request, const struct fileInfo * file)
+{
+  if (request->ifNoneMatch[0] != '\0')
+  {
+    const char * etag = file->etag;
+    const char * opaque = strncmp(etag, "W/", 2) == 0 ? etag + 2 : etag;
+    size_t opaqueLength = strlen(opaque);
+    const char * candidate = request->ifNoneMatch;
+    while (*candidate != '\0')
+    {
+      candidate += strspn(candidate, " \t,");
+      size_t length = strcspn(candidate, " \t,");
+      if (length == 1 && *candidate == '*')
+        return 1;
+      if (length > 2 && strncmp(candidate, "W/", 2) == 0)
+      {
+        candidate += 2;
+        length -= 2;
+      }
+      if (length == opaqueLength && strncmp(candidate, opaque, length) == 0)
+        return 1;
+      candidate += length;
+    }
+    return 0;
+  }
+  return request->ifModifiedSince != -1 && file->stat.st_mtime <= request->ifModifiedSince;
+}
+
+/**
+ * Looks up the reason phrase of a status code.
+ * \param statusCode One of the HTTP status codes the server sends.
+ * \returns Code and reason phrase, e.g. "200 OK", 0 for unknown codes.
+ */
+const char * statusText(int statusCode)
+{
+  switch (statusCode)
+  {
+    case 200:
+      return "200 OK";
+    case 204:
+      return "204 No Content";
+    case 206:
+      return "206 Partial Content";
+    case 304:
+      return "304 Not Modified";
+    case 400:
+      return "400 Bad Request";
+    case 404:
+      return "404 Not Found";
+    case 405:
+      return "405 Method Not Allowed";
+    case 416:
+      return "416 Range Not Satisfiable";
+    case 500:
+      return "500 Internal Server Error";
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Returns the current time in HTTP format. It is formatted once a second.
+ * \param seconds Receives the current time, may be 0.
+ * \returns The date, valid until the next call.
+ */
+const char * currentHttpDate(time_t * seconds)
+{
+  time_t currentSeconds = time(NULL);
+  if (currentSeconds != httpDateSeconds)
+  {
+    struct tm currentGMT;
+    gmtime_r(&currentSeconds, &currentGMT);
+    if (strftime(httpDate, FILE_DATE_SIZE, "%a, %d %b %Y %H:%M:%S GMT", &currentGMT) == 0)
+    {
+      fputs("Error creating dateMessage", stderr);
+      exit(1);
+    }
+    httpDateSeconds = currentSeconds;
+  }
+  if (seconds != 0)
+    *seconds = currentSeconds;
+  return httpDate;
+}
+
+/**
+ * Formats the headers for the given \a statusCode.
+ * \param headers Receives the headers.
+ * \param space Size of \a headers.
+ * \param status The status line, see \a statusText.
+ * \param contentLength Length of the body, -1 if there is none.
+ * \param contentType Type of the body, 0 if there is none.
+ * \param file The file the answer is about, its validators (ETag,
+ * Last-Modified) are sent along. 0 if there is none.
+ * \param extraHeaders Further header lines, each ending with CRLF, 0 if there are none.
+ * \param keepAlive 1 if the connection stays open after the answer.
+ * \returns The length of the headers, \a space or more if they do not fit.
+ */
+int formatHeaders(char * headers, int space, const char * status, long contentLength,
+                  const char * contentType, const struct fileInfo * file,
+                  const char * extraHeaders, int keepAlive)
+{
+  char lengthMessage[40] = "";
+  if (contentLength >= 0)
+    sprintf(lengthMessage, "Content-Length: %ld\r\n", contentLength);
+  char validators[FILE_ETAG_SIZE + FILE_DATE_SIZE + 64] = "";
+  if (file != 0)
+    sprintf(validators, "ETag: %s\r\nLast-Modified: %s\r\nAccept-Ranges: bytes\r\n",
+            file->etag, file->lastModified);
+  /* the date comes first, see answerFromHeaderRoom */
+  return snprintf(headers, space, "HTTP/1.1 %s\r\nDate: %s\r\n%s%s%s%s%s%sConnection: %s\r\n\r\n",
+                  status, currentHttpDate(0), lengthMessage,
+                  contentType ? "Content-Type: " : "", contentType ? contentType : "",
+                  contentType ? "\r\n" : "", validators, extraHeaders ? extraHeaders : "",
+                  keepAlive ? "keep-alive" : "close");
+}
+
+/**
+ * Appends a bare 500 answer to the buffer in place of one that does not
+ * fit, if there is room for it. The connection is closed after the answers
+ * buffered so far.
+ * \param connection Connection in whose buffer the answer is stored.
+ */
+void bufferInternalError(struct connectionType * connection)
+{
+  connection->keepAlive = 0;
+  int space = connection->bufferSize - connection->bufferLength;
+  int length = formatHeaders(connection->buffer + connection->bufferLength, space,
+                             statusText(500), 0, 0, 0, 0, 0);
+  if (length < space)
+    connection->bufferLength += length;
+}
+
+/**
+ * Appends the headers for the given \a statusCode to the buffer
+ * \param connection Connection in whose buffer the headers are stored.
+ * \param statusCode HTTP status code that determines the headers.
+ * \param contentLength Length of the body, -1 if unknown. Then the end of the
+ * body is marked by closing the connection.
+ * \param contentType Type of the body, 0 if there is none.
+ * \param file The file the answer is about, its validators (ETag,
+ * Last-Modified) are sent along. 0 if there is none.
+ * \param extraHeaders Further header lines, each ending with CRLF, 0 if there are none.
+ * \returns 1 on success, 0 if the headers do not fit into the buffer. A bare
+ * 500 answer is buffered instead, see \a bufferInternalError, no content may follow.
+ */
+int bufferHeaders(struct connectionType * connection, int statusCode, long contentLength,
+                  const char * contentType, const struct fileInfo * file,
+                  const char * extraHeaders)
+{
+  const char * status = statusText(statusCode);
+  if (status == 0)
+    return 0;
+#ifdef DEBUG
+  printf("Buffering %s headers\n", status);
+#endif
+  if (contentLength < 0)
+    connection->keepAlive = 0;
+  else if (statusCode == 204 || statusCode == 304) /* have no body at all */
+    contentLength = -1;
+  int space = connection->bufferSize - connection->bufferLength;
+  int length = formatHeaders(connection->buffer + connection->bufferLength, space, status,
+                             contentLength, contentType, file, extraHeaders, connection->keepAlive);
+  if (length >= space)
+  {
+    doLog(errorLog, "Buffer too small for HTTP answer %d", statusCode);
+    bufferInternalError(connection);
+    return 0;
+  }
+  connection->bufferLength += length;
+  return 1;
+}
+
+/**
+ * Checks the If-Range condition of a request with a Range header. Ranges
+ * are only served if the client's copy is still current, otherwise it needs
+ * the whole file. Entity tags are compared strongly, so weak ones never match.
+ * \param request The conditions of the request.
+ * \param file The file's status and validators, see \a describeFile.
+ * \returns 1 if the ranges are to be served, 0 otherwise.
+ */
+int rangeApplies(const struct fileRequest * request, const struct fileInfo * file)
+{
+  if (request->range[0] == '\0')
+    return 0;
+  if (request->ifRange[0] == '\0')
+    return 1;
+  if (request->ifRange[0] == '"')
+    return strcmp(file->etag, request->ifRange) == 0;
+  return parseHttpDate(request->ifRange, strlen(request->ifRange)) == file->stat.st_mtime;
+}
+
+/**
+ * Parses a Range header against the size of the file (RFC 7233).
+ * \param header The value of the Range header.
+ * \param size The size of the file.
+ * \param ranges Receives the satisfiable ranges, \a MAX_RANGES entries.
+ * \returns The number of satisfiable ranges (0 if there are none), or -1 if
+ * the header is invalid or asks for too many ranges and is to be ignored.
+ */
+int parseRanges(const char * header, long size, struct byteRange * ranges)
+{
+  if (strncmp(header, "bytes=", 6) != 0)
+    return -1;
+  const char * spec = header + 6;
+  int count = 0;
+  int specCount = 0;
+  for (;;)
+  {
+    struct byteRange range;
+    char * end;
+    spec += strspn(spec, " \t");
+    if (*spec == '-' && spec[1] >= '0' && spec[1] <= '9')
+    {
+      /* the last n bytes */
+      long suffix = strtol(spec + 1, &end, 10);
+      range.first = suffix == 0 ? size : (suffix < size ? size - suffix : 0);
+      range.last = size - 1;
+    }
+    else if (*spec >= '0' && *spec <= '9')
+    {
+      range.first = strtol(spec, &end, 10);
+      if (*end != '-')
+        return -1;
+      ++end;
+      range.last = size - 1;
+      if (*end >= '0' && *end <= '9')
+      {
+        long last = strtol(end, &end, 10);
+        if (last < range.first)
+          return -1;
+        if (last < range.last)
+          range.last = last;
+      }
+    }
+    else
+      return -1;
+    if (++specCount > MAX_RANGES)
+      return -1;
+    if (range.first < size)
+      ranges[count++] = range;
+    spec = end + strspn(end, " \t");
+    if (*spec == '\0')
+      return count;
+    if (*spec != ',')
+      return -1;
+    ++spec;
+  }
+}
+
+/**
+ * Formats the headers of one part of a multipart/byteranges answer.
+ * \param multipart The answer.
+ * \param part Index of the part.
+ * \param header Receives the headers, \a PART_HEADER_SIZE characters.
+ * \returns The length of the headers.
+ */
+int formatPartHeader(const struct multipartAnswer * multipart, int part, char * header)
+{
+  return snprintf(header, PART_HEADER_SIZE,
+                  "\r\n--" MULTIPART_BOUNDARY "\r\nContent-Type: %s\r\nContent-Range: bytes %ld-%ld/%ld\r\n\r\n",
+                  multipart->contentType, multipart->ranges[part].first,
+                  multipart->ranges[part].last, multipart->fileSize);
+}
+
+/**
+ * Appends the headers of the next part of a multipart/byteranges answer and
+ * points the file at its range, or appends the closing delimiter after the
+ * last part.
+ * \param connection The connection sending the answer, its current range is sent.
+ * \returns 1 if something was appended, 0 if the answer is complete or
+ * there is no room in the buffer.
+ */
+int bufferNextPart(struct connectionType * const connection)
+{
+  struct multipartAnswer * multipart = connection->multipart;
+  if (multipart == NULL || multipart->nextPart > multipart->rangeCount
+      || connection->bufferSize - connection->bufferLength < PART_HEADER_SIZE)
+    return 0;
+  char * end = connection->buffer + connection->bufferLength;
+  if (multipart->nextPart == multipart->rangeCount)
+  {
+    memcpy(end, MULTIPART_END, strlen(MULTIPART_END));
+    connection->bufferLength += strlen(MULTIPART_END);
+  }
+  else
+  {
+    const struct byteRange * range = &multipart->ranges[multipart->nextPart];
+    connection->bufferLength += formatPartHeader(multipart, multipart->nextPart, end);
+    connection->fileOffset = range->first;
+    connection->fileRemaining = range->last - range->first + 1;
+  }
+  ++multipart->nextPart;
+  return 1;
+}
+
+/**
+ * Starts over with an empty buffer for the next part of a multipart/byteranges
+ * answer, after everything of the current one has been sent.
+ * \param connection The connection sending the answer.
+ * \returns 1 if there is something to send, 0 if the answer is complete.
+ */
+int startNextPart(struct connectionType * const connection)
+{
+  if (connection->multipart == NULL || connection->fileRemaining != 0)
+    return 0;
+  connection->bufferFreeOffset = 0;
+  connection->bufferLength = 0;
+  return bufferNextPart(connection);
+}
+
+/**
+ * Appends the headers of an answer to a Range request and prepares sending
+ * the ranges: one range is sent as it is, several ones as multipart/byteranges.
+ * \param connection The connection, its file is open.
+ * \param contentType Type of the file.
+ * \param file The file's status and validators.
+ * \param ranges The satisfiable ranges, see \a parseRanges.
+ * \param rangeCount Number of \a ranges, 0 if none of the requested ranges is satisfiable.
+ * \returns The status code sent, 0 if nothing was sent for lack of memory.
+ */
+int bufferRangeHeaders(struct connectionType * connection, const char * contentType,
+                       const struct fileInfo * file, const struct byteRange * ranges,
+                       int rangeCount)
+{
+  char contentRange[80];
+  if (rangeCount == 0)
+  {
+    sprintf(contentRange, "Content-Range: bytes */%ld\r\n", (long)file->stat.st_size);
+    int statusCode = bufferHeaders(connection, 416, 0, 0, file, contentRange) ? 416 : 500;
+    closeFile(connection);
+    connection->fileRemaining = 0;
+    return statusCode;
+  }
+  if (rangeCount == 1)
+  {
+    sprintf(contentRange, "Content-Range: bytes %ld-%ld/%ld\r\n",
+            ranges[0].first, ranges[0].last, (long)file->stat.st_size);
+    connection->fileOffset = ranges[0].first;
+    connection->fileRemaining = ranges[0].last - ranges[0].first + 1;
+    if (!bufferHeaders(connection, 206, connection->fileRemaining, contentType, file, contentRange))
+    {
+      closeFile(connection);
+      connection->fileRemaining = 0;
+      return 500;
+    }
+    return 206;
+  }
+  struct multipartAnswer * multipart =
+    (struct multipartAnswer *)allocBuffer(&bufferPool, sizeof(struct multipartAnswer));
+  if (multipart == NULL)
+    return 0;
+  multipart->contentType = contentType;
+  multipart->fileSize = file->stat.st_size;
+  multipart->rangeCount = rangeCount;
+  multipart->nextPart = 0;
+  memcpy(multipart->ranges, ranges, rangeCount * sizeof(struct byteRange));
+  long length = strlen(MULTIPART_END);
+  int i;
+  for (i = 0; i < rangeCount; ++i)
+  {
+    char header[PART_HEADER_SIZE];
+    length += formatPartHeader(multipart, i, header) + ranges[i].last - ranges[i].first + 1;
+  }
+  connection->fileRemaining = 0;
+  if (!bufferHeaders(connection, 206, length, "multipart/byteranges; boundary=" MULTIPART_BOUNDARY,
+                     file, 0))
+  {
+    releaseBuffer(&bufferPool, (char *)multipart, sizeof(struct multipartAnswer));
+    closeFile(connection);
+    return 500;
+  }
+  connection->multipart = multipart;
+  /* if the first part does not fit behind the headers, it follows them */
+  bufferNextPart(connection);
+  return 206;
+}
+
+/**
+ * Appends the headers of an answer whose body is the connection's file.
+ * \param connection The connection, its file is already open (none for an empty body).
+ * \param statusCode HTTP status code that determines the headers.
+ * \param contentType Type of the file, see \a mimeType.
+ * \param withBody 0 to answer a HEAD request: the file is closed after the
+ * headers, which describe it nevertheless.
+ * \param conditions The request for the file, if its validators are to be
+ * sent and checked. A file the client has already gets a 304 instead, a
+ * Range request a 206 or 416.
+ * \returns The status code actually sent.
+ */
+int bufferFileHeaders(struct connectionType * connection, int statusCode,
+                      const char * contentType, int withBody,
+                      const struct fileRequest * conditions)
+{
+  struct fileInfo fileInfo;
+  const struct fileInfo * file = 0;
+  long length = 0;
+  connection->fileOffset = 0;
+  /* cached files come with their validators */
+  if (connection->cachedFile != NULL)
+    file = &connection->cachedFile->info;
+  else if (connection->fileFd != -1 && fstat(connection->fileFd, &fileInfo.stat) == 0)
+  {
+    describeFile(&fileInfo.stat, &fileInfo);
+    file = &fileInfo;
+  }
+  if (file != 0)
+    length = file->stat.st_size;
+  else if (connection->fileFd != -1)
+    length = -1;
+  const struct fileInfo * validated = conditions != 0 ? file : 0;
+  if (validated != 0 && fileNotModified(conditions, validated))
+  {
+    statusCode = 304;
+    withBody = 0;
+    contentType = 0;
+  }
+  else if (validated != 0 && withBody && rangeApplies(conditions, validated))
+  {
+    struct byteRange ranges[MAX_RANGES];
+    int rangeCount = parseRanges(conditions->range, length, ranges);
+    int rangeStatus = rangeCount >= 0
+                      ? bufferRangeHeaders(connection, contentType, validated, ranges, rangeCount)
+                      : 0;
+    if (rangeStatus != 0)
+    {
+      adviseFileReads(connection);
+      return rangeStatus;
+    }
+  }
+  if (!withBody && length < 0)
+    length = 0; /* nothing follows, so the connection can stay open anyway */
+  if (!bufferHeaders(connection, statusCode, length, hasFile(connection) ? contentType : 0,
+                     validated, 0))
+  {
+    closeFile(connection);
+    connection->fileRemaining = 0;
+    return 500;
+  }
+  connection->fileRemaining = length;
+  if (!withBody && hasFile(connection))
+  {
+    closeFile(connection);
+    connection->fileRemaining = 0;
+  }
+  else
+    adviseFileReads(connection);
+  return statusCode;
+}
+
+/**
+ * Appends as much of the connection's file to the buffer as fits. A file
+ * that has been read completely is closed, so further answers may follow.
+ * Read errors are left to \a sendConnection. Large files of the cache are
+ * not copied, they are sent in place after the headers.
+ * \param connection The connection whose answer is being buffered.
+ */
+void bufferFileContent(struct connectionType * connection)
+{
+  if (!hasFile(connection))
+    return;
+  unsigned int space = connection->bufferSize - connection->bufferLength;
+  if (connection->fileRemaining >= 0 && connection->fileRemaining < space)
+    space = connection->fileRemaining;
+  int len = 0;
+  if (fileInMemory(connection))
+  {
+    if (!connection->cachedFile->sentInPlace)
+    {
+      memcpy(connection->buffer + connection->bufferLength,
+             connection->cachedFile->data + connection->fileOffset, space);
+      len = space;
+    }
+  }
+  else if (space > 0)
+  {
+#ifdef RWF_NOWAIT
+    if (fileWorkers.threadCount > 0)
+    {
+      /* what is not in the page cache follows, read by a worker */
+      struct iovec piece;
+      piece.iov_base = connection->buffer + connection->bufferLength;
+      piece.iov_len = space;
+      len = preadv2(connection->fileFd, &piece, 1, connection->fileOffset, RWF_NOWAIT);
+    }
+    else
+#endif
+      len = pread(connection->fileFd, connection->buffer + connection->bufferLength,
+                  space, connection->fileOffset);
+  }
+  if (len > 0)
+  {
+    connection->bufferLength += len;
+    connection->fileOffset += len;
+    if (connection->fileRemaining > 0)
+      connection->fileRemaining -= len;
+  }
+  /* the further parts of a multipart answer need the file */
+  if (connection->fileRemaining == 0 && connection->multipart == NULL)
+    closeFile(connection);
+}
+
+/**
+ * Send the content of a buffer through the network, together with the
+ * file behind it if that is in memory (see \a gatherAnswer).
+ * \param connection The connection whose buffer and network
+ * socket are to be used.
+ * \returns 1 if something was sent, 0 if the socket would block and -1 on
+ * errors (errno is set).
+ */
+int sendBuffer(struct connectionType * const connection)
+{
+  struct iovec parts[2];
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = parts;
+  message.msg_iovlen = gatherAnswer(connection, parts);
+  /* a client that went away must not kill us with SIGPIPE */
+  int flags = MSG_NOSIGNAL;
+#ifdef HAVE_SENDFILE
+  /* sendfile follows, the headers wait to go out with the first piece of the file */
+  if (connection->fileFd != -1 && connection->fileRemaining != 0)
+    flags |= MSG_MORE;
+#endif
+  ssize_t sent = sendmsg(connection->socketFd, &message, flags);
+  if (sent == -1)
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+  advanceAnswer(connection, sent);
+  return 1;
+}
+
+/**
+ * Decides whether the client wants to keep the connection open.
+ * \param request A complete request.
+ * \returns 1 for keep-alive, 0 otherwise.
+ */
+int requestKeepAlive(const struct httpRequest * request)
+{
+  const struct httpView * connectionHeader = knownHttpHeader(request, httpConnection);
+  if (connectionHeader != 0 && httpViewEqualsIgnoreCase(connectionHeader, "close"))
+    return 0;
+  if (connectionHeader != 0 && httpViewEqualsIgnoreCase(connectionHeader, "keep-alive"))
+    return 1;
+  /* HTTP/1.1 keeps connections open by default */
+  return httpViewEquals(&request->version, "HTTP/1.1");
+}
+
+/**
+ * Reads the Content-Length header of a request.
+ * \param request A complete request.
+ * \returns The length of the body, 0 if there is none and -1 if the header is invalid.
+ */
+int requestContentLength(const struct httpRequest * request)
+{
+  const struct httpView * lengthHeader = knownHttpHeader(request, httpContentLength);
+  if (lengthHeader == 0)
+    return 0;
+  if (lengthHeader->length == 0 || lengthHeader->length > 9)
+    return -1;
+  int length = 0;
+  unsigned int i;
+  for (i = 0; i < lengthHeader->length; ++i)
+  {
+    if (lengthHeader->data[i] < '0' || lengthHeader->data[i] > '9')
+      return -1;
+    length = length * 10 + (lengthHeader->data[i] - '0');
+  }
+  return length;
+}
+
+/**
+ * Checks whether a request goes to the chat service.
+ * \param request A complete request.
+ * \returns 1 for a chat request, 0 otherwise.
+ */
+int isChatRequest(const struct httpRequest * request)
+{
+  return httpViewEquals(&request->method, "POST") && httpViewEquals(&request->target, CHAT_URL);
+}
+
+/**
+ * Checks whether a request asks for a file with a method that is served.
+ * \param request A complete request.
+ * \returns 1 for GET and HEAD, 0 otherwise.
+ */
+int isFileMethod(const struct httpRequest * request)
+{
+  return httpViewEquals(&request->method, "GET") || httpViewEquals(&request->method, "HEAD");
+}
+
+/**
+ * Maps the target of a request to a file below the document root. The
+ * query is dropped and the path is normalized: empty and "." segments are
+ * removed, ".." removes the segment before it but never leaves the root.
+ * The same file thus always gets the same path, the key of the file cache.
+ * \param request A complete request.
+ * \param filepath Receives the path, at least \a MAX_FILE_PATH_SIZE characters.
+ * \returns 1 on success, 0 if the target is too long.
+ */
+int buildFilePath(const struct httpRequest * request, char * filepath)
+{
+  /* a missing leading slash is added */
+  if (request->target.length >= MAX_URL_SIZE - 1)
+    return 0;
+  strcpy(filepath, documentRoot);
+  char * path = filepath + strlen(documentRoot);
+  unsigned int length = 0;
+  const char * segment = request->target.data;
+  const char * end = memchr(segment, '?', request->target.length);
+  if (end == NULL)
+    end = segment + request->target.length;
+  while (segment < end)
+  {
+    const char * next = memchr(segment, '/', end - segment);
+    if (next == NULL)
+      next = end;
+    unsigned int segmentLength = next - segment;
+    if (segmentLength == 2 && segment[0] == '.' && segment[1] == '.')
+    {
+      while (length > 0 && path[--length] != '/')
+        ;
+    }
+    else if (segmentLength > 0 && !(segmentLength == 1 && segment[0] == '.'))
+    {
+      path[length++] = '/';
+      memcpy(path + length, segment, segmentLength);
+      length += segmentLength;
+    }
+    segment = next + 1;
+  }
+  /* a trailing slash still names a directory */
+  if (length == 0 || end[-1] == '/')
+    path[length++] = '/';
+  path[length] = '\0';
+  return 1;
+}
+
+/**
+ * Copies everything the answer to a GET or HEAD request depends on out of
+ * the request, whose views die with the receive buffer. Conditions that
+ * cannot be evaluated are dropped, the full answer is always correct.
+ * \param request A complete request.
+ * \param fileRequest Receives the file, method and conditions.
+ * \returns 1 on success, 0 if the target is too long.
+ */
+int describeFileRequest(const struct httpRequest * request, struct fileRequest * fileRequest)
+{
+  if (!buildFilePath(request, fileRequest->filepath))
+    return 0;
+  fileRequest->withBody = !httpViewEquals(&request->method, "HEAD");
+  fileRequest->ifNoneMatch[0] = '\0';
+  fileRequest->ifModifiedSince = -1;
+  const struct httpView * header = knownHttpHeader(request, httpIfNoneMatch);
+  if (header != 0)
+  {
+    if (header->length < MAX_CONDITION_SIZE)
+    {
+      memcpy(fileRequest->ifNoneMatch, header->data, header->length);
+      fileRequest->ifNoneMatch[header->length] = '\0';
+    }
+  }
+  else
+  {
+    /* If-Modified-Since is ignored with If-None-Match */
+    header = knownHttpHeader(request, httpIfModifiedSince);
+    if (header != 0)
+      fileRequest->ifModifiedSince = parseHttpDate(header->data, header->length);
+  }
+  fileRequest->range[0] = '\0';
+  fileRequest->ifRange[0] = '\0';
+  header = knownHttpHeader(request, httpRange);
+  const struct httpView * ifRange = knownHttpHeader(request, httpIfRange);
+  /* without the condition, the range could come from another version of the file */
+  if (header != 0 && header->length < MAX_CONDITION_SIZE
+      && (ifRange == 0 || ifRange->length < MAX_CONDITION_SIZE))
+  {
+    memcpy(fileRequest->range, header->data, header->length);
+    fileRequest->range[header->length] = '\0';
+    if (ifRange != 0)
+    {
+      memcpy(fileRequest->ifRange, ifRange->data, ifRange->length);
+      fileRequest->ifRange[ifRange->length] = '\0';
+    }
+  }
+  return 1;
+}
+
+/**
+ * Returns the snapshot of the document root this loop answers from. After
+ * a reload the loop lets go of the old snapshot and takes the new one,
+ * answers still being sent keep the old one alive.
+ * \returns The snapshot, valid as long as the loop does not call this again.
+ */
+struct snapshot * currentLoopSnapshot()
+{
+  if (__atomic_load_n(&snapshotGeneration, __ATOMIC_ACQUIRE) != loopSnapshotGeneration)
+  {
+    pthread_mutex_lock(&snapshotLock);
+    struct snapshot * snapshot = currentSnapshot;
+    retainSnapshot(snapshot);
+    loopSnapshotGeneration = snapshotGeneration;
+    pthread_mutex_unlock(&snapshotLock);
+    if (loopSnapshot != NULL)
+      releaseSnapshot(loopSnapshot);
+    loopSnapshot = snapshot;
+  }
+  return loopSnapshot;
+}
+
+/**
+ * Appends the counters of a pool to a status report.
+ * \param report The report to append to.
+ * \param size Space left in \a report.
+ * \param name Name of the pool.
+ * \param stats The counters to report.
+ * \returns The number of characters appended.
+ */
+int formatPoolStats(char * report, int size, const char * name, const struct poolStats * stats)
+{
+  unsigned long requests = stats->hits + stats->misses;
+  int length = snprintf(report, size,
+                        "%s: %lu allocations, %.1f%% hit rate, %lu bytes resident, %lu bytes in use\n",
+                        name, requests, requests == 0 ? 0.0 : 100.0 * stats->hits / requests,
+                        (unsigned long)stats->residentBytes, (unsigned long)stats->usedBytes);
+  return min(length, size - 1);
+}
+
+/**
+ * Stores an answer with a plain text report on the server's state in the buffer.
+ * The counters of other loops are read while they run and may be slightly stale.
+ * \param connection Connection in whose buffer the report is stored.
+ * \param withBody 0 to store only the headers (HEAD request).
+ */
+void bufferServerStatus(struct connectionType * connection, int withBody)
+{
+  struct poolStats connections, buffers;
+  memset(&connections, 0, sizeof(connections));
+  memset(&buffers, 0, sizeof(buffers));
+  int i;
+  /* the other loops change them meanwhile */
+  for (i = 0; i < threadCount; ++i)
+  {
+    if (!__atomic_load_n(&loops[i].running, __ATOMIC_ACQUIRE))
+      continue;
+    connections.hits += STATS_READ(loops[i].connectionPool->stats.hits);
+    connections.misses += STATS_READ(loops[i].connectionPool->stats.misses);
+    connections.residentBytes += STATS_READ(loops[i].connectionPool->stats.residentBytes);
+    connections.usedBytes += STATS_READ(loops[i].connectionPool->stats.usedBytes);
+    buffers.hits += STATS_READ(loops[i].bufferPool->stats.hits);
+    buffers.misses += STATS_READ(loops[i].bufferPool->stats.misses);
+    buffers.residentBytes += STATS_READ(loops[i].bufferPool->stats.residentBytes);
+    buffers.usedBytes += STATS_READ(loops[i].bufferPool->stats.usedBytes);
+  }
+  struct sheddingStats shedding;
+  memset(&shedding, 0, sizeof(shedding));
+  struct fileCacheStats cached;
+  memset(&cached, 0, sizeof(cached));
+  int open = 0;
+  for (i = 0; i < threadCount; ++i)
+  {
+    if (!__atomic_load_n(&loops[i].running, __ATOMIC_ACQUIRE))
+      continue;
+    open += STATS_READ(*loops[i].connectionCount);
+    shedding.rejected += STATS_READ(loops[i].sheddingStats->rejected);
+    shedding.pauses += STATS_READ(loops[i].sheddingStats->pauses);
+    cached.hits += STATS_READ(loops[i].fileCache->stats.hits);
+    cached.misses += STATS_READ(loops[i].fileCache->stats.misses);
+    cached.evictions += STATS_READ(loops[i].fileCache->stats.evictions);
+    cached.invalidations += STATS_READ(loops[i].fileCache->stats.invalidations);
+    cached.files += STATS_READ(loops[i].fileCache->stats.files);
+    cached.descriptors += STATS_READ(loops[i].fileCache->stats.descriptors);
+    cached.bytes += STATS_READ(loops[i].fileCache->stats.bytes);
+  }
+  char report[STATUS_REPORT_SIZE];
+  int size = sizeof(report);
+  int length = formatPoolStats(report, size, "connection pool", &connections);
+  length += formatPoolStats(report + length, size - length, "buffer pool", &buffers);
+  length += min(snprintf(report + length, size - length,
+                         "admission: %d of %d connections, %lu rejected, accept paused %lu times\n",
+                         open, maxConnections, shedding.rejected, shedding.pauses),
+                size - length - 1);
+  unsigned long lookups = cached.hits + cached.misses;
+  length += min(snprintf(report + length, size - length,
+                         "file cache: %.1f%% hit rate, %lu files, %lu bytes, %lu open, %lu evictions, %lu invalidations\n",
+                         lookups == 0 ? 0.0 : 100.0 * cached.hits / lookups, cached.files,
+                         (unsigned long)cached.bytes, cached.descriptors, cached.evictions,
+                         cached.invalidations),
+                size - length - 1);
+  if (preloadDocuments)
+  {
+    const struct snapshot * snapshot = currentLoopSnapshot();
+    length += min(snprintf(report + length, size - length, "snapshot: %u files, %lu bytes\n",
+                           snapshot->fileCount, (unsigned long)snapshot->arenaSize),
+                  size - length - 1);
+  }
+  unsigned int start = connection->bufferLength;
+  if (!bufferHeaders(connection, 200, length, "text/plain", 0, 0))
+    return;
+  if (withBody && connection->bufferLength + length >= connection->bufferSize)
+  {
+    doLog(errorLog, "Buffer too small for the status report");
+    connection->bufferLength = start;
+    bufferInternalError(connection);
+    return;
+  }
+  if (!withBody)
+    return;
+  memcpy(connection->buffer + connection->bufferLength, report, length);
+  connection->bufferLength += length;
+}
+
+/**
+ * Receive a string message through a socket.
+ * \param sock Socket descriptor for the socket to receive the message through.
+ * \param buffer Buffer for buffering the message we receive.
+ * \param size Size of the \a buffer.
+ * \returns The number of bytes received, 0 on end of file and -1 if the
+ * socket would block or on errors (errno is set).
+ */
+int receiveMessage(int sock, char* buffer, int size)
+{
+  return read(sock, buffer, size);
+}
+
+/**
+ * Appends a message to the chat log
+ * \param message The message to append.
+ * \param length The length of the message.
+ */
+void appendToChatLog(char * message, int length)
+{
+  int file = open(CHATLOGFILE, O_WRONLY | O_APPEND);
+  assert(file != -1);
+  write(file, message, length);
+  close(file);
+}
+
+/**
+ * Sends the chat log to all chat receivers of this event loop.
+ */
+void distributeChatLog()
+{
+  int i;
+  /* backwards, closing a connection moves the last one into its slot */
+  for (i = nextFreePollStructIndex - 1; i >= RESERVED_POLL_SLOTS; --i)
+  {
+    struct connectionType * conIt = connectionTable[i];
+    if (conIt->status == statusChatReceiver)
+    {
+      unparkConnection(conIt);
+      /* the buffer was given back while the receiver was parked */
+      if (!attachBuffer(conIt))
+      {
+        closeConnection(conIt);
+        continue;
+      }
+      conIt->fileFd = open(CHATLOGFILE, O_RDONLY);
+      assert(conIt->fileFd != -1);
+      assert(conIt->fileFd != 0);
+      bufferFileHeaders(conIt, 200, "text/plain", 1, 0);
+      bufferFileContent(conIt);
+      conIt->status = statusOutgoingAnswer;
+      setConnectionEvents(conIt, POLLOUT);
+    }
+  }
+}
+
+/**
+ * Wakes up all other event loops so they distribute the chat log to their receivers.
+ */
+void notifyOtherLoops()
+{
+  const uint64_t one = 1;
+  int i;
+  for (i = 0; i < threadCount; ++i)
+    if (loops[i].wakeupFd != wakeupFd)
+    {
+      __atomic_store_n(&loops[i].chatPending, 1, __ATOMIC_RELEASE);
+      if (write(loops[i].wakeupFd, &one, sizeof(one)) == -1)
+        perror("Error waking up event loop");
+    }
+}
+
+#ifdef HAVE_INOTIFY
+/**
+ * Lets the file cache check its files only while not all changes of the
+ * documents are reported.
+ */
+void updateCheckInterval()
+{
+  if (!directoryWatch.complete && fileCache.checkInterval == FILE_CACHE_NO_CHECK)
+    doLog(errorLog, "Not all documents can be watched, cached files are checked instead");
+  fileCache.checkInterval = directoryWatch.complete ? FILE_CACHE_NO_CHECK : (unsigned long)fileCacheValid;
+}
+
+/**
+ * Watches the document root and the error documents, so the file cache
+ * learns of their changes instead of checking its files.
+ */
+void startDirectoryWatch()
+{
+  if (initDirectoryWatch(&directoryWatch) == -1)
+  {
+    perror("Error creating inotify instance, cached files are checked instead");
+    return;
+  }
+  /* the cache is empty, nothing changed before the watches */
+  fileCache.checkInterval = FILE_CACHE_NO_CHECK;
+  watchDirectory(&directoryWatch, documentRoot, DIRECTORY_WATCH_MAX_DEPTH);
+  watchDirectory(&directoryWatch, ERROR_DOCUMENT_DIRECTORY, 0);
+  updateCheckInterval();
+}
+
+/**
+ * Drops the cached files that changed since the last call.
+ */
+void handleDirectoryChanges()
+{
+  handleDirectoryEvents(&directoryWatch, &fileCache);
+  updateCheckInterval();
+}
+#endif
+
+/**
+ * Prints the message to the chat log and closes the connection if
+ * the currently received body is long enough to include the
+ * complete chat message. Afterwards distributes the message to all clients.
+ * \param connection The connection to check.
+ * \returns 1 if the message was complete and the connection is closed, 0 otherwise.
+ */
+int checkChatMessageComplete(struct connectionType * const connection)
+{
+  if (connection->body + connection->contentLength
+      <= connection->buffer + connection->bufferFreeOffset)
+  {
+    appendToChatLog(connection->body, connection->contentLength);
+    closeConnection(connection);
+    /* distribute new message */
+    distributeChatLog();
+    notifyOtherLoops();
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Makes sure there is free space in the receive buffer of a connection.
+ * \param connection The connection whose buffer might be full.
+ * \returns 1 on success, 0 if the buffer may not grow and the connection was closed.
+ */
+int ensureReceiveSpace(struct connectionType * const connection)
+{
+  /* increase buffer size if necessary, one byte is kept for the terminating '\0' */
+  if (connection->bufferFreeOffset + 1 >= connection->bufferSize)
+  {
+    if (connection->bufferSize >= MAX_BUFFER_SIZE)
+    {
+      closeConnection(connection);
+      return 0;
+    }
+    char * newSpace = growBuffer(&bufferPool, connection->buffer, connection->bufferSize,
+                                 connection->bufferSize * 2, connection->bufferFreeOffset);
+    if (newSpace == NULL)
+    {
+      closeConnection(connection);
+      return 0;
+    }
+    /* the body of a chat message and the parsed parts of the request move along */
+    if (connection->body != NULL)
+      connection->body = newSpace + (connection->body - connection->buffer);
+    rebaseHttpRequest(&connection->request, connection->buffer, newSpace);
+    connection->bufferSize = bufferClassSize(connection->bufferSize * 2);
+    connection->buffer = newSpace;
+  }
+  return 1;
+}
+
+/**
+ * Counts a request and decides whether the connection is kept open afterwards.
+ * \param connection The connection the request was received on.
+ * \param keepAlive 1 if the client asked to keep the connection open.
+ */
+void countRequest(struct connectionType * const connection, int keepAlive)
+{
+  ++connection->requestCount;
+  connection->keepAlive = keepAlive
+                          && (maxRequests == 0 || connection->requestCount < maxRequests);
+  if (connection->keepAlive && connection->requestCount == 1)
+  {
+    /*
+     * without a closing FIN, Nagle holds back the last piece of every
+     * answer until the client's delayed ACK arrives
+     */
+    int one = 1;
+    setsockopt(connection->socketFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+}
+
+/**
+ * Takes the file a worker opened into the file cache.
+ * \param connection The connection that answers with the file.
+ * \param job The completed job, it is released.
+ */
+void takeOpenedFile(struct connectionType * const connection, struct fileJob * job)
+{
+  connection->fileFd = job->fd;
+  connection->cachedFile = addCachedFile(&fileCache, job->file, job->generation, loopTime,
+                                         &connection->fileFd);
+  /* a change was reported meanwhile, the entry may show the old file */
+  if (job->file != 0 && connection->cachedFile == NULL)
+    connection->cachedFile = openCachedFile(&fileCache, job->request.filepath, loopTime,
+                                            &connection->fileFd);
+  releaseBuffer(&bufferPool, (char *)job, sizeof(struct fileJob));
+}
+
+/**
+ * Opens the file of an answer: from the snapshot when preloading, through
+ * the file cache otherwise.
+ * \param connection The connection that answers with the file.
+ * \param path The file's path.
+ * \returns 1 if the file is there, 0 otherwise.
+ */
+int openAnswerFile(struct connectionType * const connection, const char * path)
+{
+  if (preloadDocuments)
+  {
+    connection->cachedFile = findSnapshotFile(currentLoopSnapshot(), path);
+    if (connection->cachedFile != NULL)
+      retainSnapshot(connection->cachedFile->snapshot);
+  }
+  else if (openedFile != NULL)
+  {
+    /* see openFileInWorker */
+    struct fileJob * job = openedFile;
+    openedFile = NULL;
+    takeOpenedFile(connection, job);
+  }
+  else
+    connection->cachedFile = openCachedFile(&fileCache, path, loopTime, &connection->fileFd);
+  return hasFile(connection);
+}
+
+/**
+ * Answers a request for a small cached file with the headers kept in front
+ * of its content, so the whole answer goes out in one piece right from the
+ * cache. They are formatted once, afterwards only the date is renewed, in
+ * place unless other answers are being sent from them. Only plain 200
+ * answers on kept-alive connections are kept.
+ * \param connection The connection the file was opened for.
+ * \param request The request, see \a describeFileRequest.
+ * \returns 1 if the answer is prepared, 0 if it needs its own headers.
+ */
+int answerFromHeaderRoom(struct connectionType * const connection, const struct fileRequest * request)
+{
+  struct cachedFile * file = connection->cachedFile;
+  /* a weak tag becomes strong once the file settles, the headers would be outdated */
+  if (file == NULL || file->headerRoom == 0 || !connection->keepAlive || file->info.etag[0] == 'W'
+      || fileNotModified(request, &file->info) || rangeApplies(request, &file->info))
+    return 0;
+  time_t now;
+  const char * date = currentHttpDate(&now);
+  const char * status = statusText(200);
+  if (file->headerLength == 0)
+  {
+    char headers[FILE_CACHE_HEADER_ROOM];
+    int length = formatHeaders(headers, sizeof(headers), status, file->info.stat.st_size,
+                               file->contentType, &file->info, 0, 1);
+    if (length >= (int)file->headerRoom)
+      return 0;
+    memcpy(file->data - length, headers, length);
+    file->headerLength = length;
+    file->dateOffset = strlen("HTTP/1.1 \r\nDate: ") + strlen(status);
+    file->headerDate = now;
+  }
+  char * headers = file->data - file->headerLength;
+  long bodyLength = request->withBody ? file->info.stat.st_size : 0;
+  if (file->headerDate != now && file->references > 1)
+  {
+    /* the others may be sending the old date right now, this answer gets a copy */
+    if (connection->bufferSize - connection->bufferLength < file->headerLength)
+      return 0;
+    char * copy = connection->buffer + connection->bufferLength;
+    memcpy(copy, headers, file->headerLength);
+    memcpy(copy + file->dateOffset, date, strlen(date));
+    connection->bufferLength += file->headerLength;
+    connection->fileOffset = 0;
+    connection->fileRemaining = bodyLength;
+  }
+  else
+  {
+    if (file->headerDate != now)
+    {
+      memcpy(headers + file->dateOffset, date, strlen(date));
+      file->headerDate = now;
+    }
+    /* the headers lie right in front of the content */
+    connection->fileOffset = -(long)file->headerLength;
+    connection->fileRemaining = file->headerLength + bodyLength;
+  }
+  /* behind earlier answers it is copied, so later ones can follow */
+  if (connection->bufferLength > 0)
+    bufferFileContent(connection);
+  return 1;
+}
+
+/**
+ * Appends the answer to a GET or HEAD request to the buffer.
+ * \param connection The connection the request was received on.
+ * \param request The request, see \a describeFileRequest.
+ */
+void bufferAnswer(struct connectionType * const connection, const struct fileRequest * request)
+{
+  const char * url = request->filepath + strlen(documentRoot);
+  const char * method = request->withBody ? "GET" : "HEAD";
+  if (strcmp(url, STATUS_URL) == 0)
+  {
+    bufferServerStatus(connection, request->withBody);
+    return;
+  }
+  /* normal file requested */
+#ifdef DEBUG
+  puts(request->filepath);
+#endif
+  /* buffer correct headers */
+  if (!openAnswerFile(connection, request->filepath))
+  {
+    doLog(errorLog, "%s %s 404 Not Found", method, url);
+    openAnswerFile(connection, NOT_FOUND_DOCUMENT);
+    bufferFileHeaders(connection, 404, mimeType(NOT_FOUND_DOCUMENT), request->withBody, 0);
+  }
+  else if (answerFromHeaderRoom(connection, request))
+  {
+    doLog(accessLog, "%s %s %s", method, url, statusText(200));
+    return;
+  }
+  else
+  {
+    /* cached files know their type */
+    const char * contentType = connection->cachedFile != NULL ? connection->cachedFile->contentType
+                                                              : mimeType(request->filepath);
+    int statusCode = bufferFileHeaders(connection, 200, contentType, request->withBody, request);
+    doLog(accessLog, "%s %s %s", method, url, statusText(statusCode));
+  }
+  bufferFileContent(connection);
+}
+
+/**
+ * Moves the bytes behind the current request into the pipeline, the buffer
+ * is needed for the answer. If there are any, the buffer is enlarged so the
+ * answers to several requests fit in.
+ * \param connection The connection whose buffer starts with the current request.
+ * \param requestLength The length of the current request.
+ * \returns 1 on success, 0 if the connection had to be closed for lack of memory.
+ */
+int stashPipelinedRequests(struct connectionType * const connection, unsigned int requestLength)
+{
+  unsigned int length = connection->bufferFreeOffset - requestLength;
+  if (length == 0)
+    return 1;
+  assert(connection->pipeline == NULL);
+  connection->pipeline = allocBuffer(&bufferPool, length + 1);
+  if (connection->pipeline == NULL)
+  {
+    closeConnection(connection);
+    return 0;
+  }
+  connection->pipelineSize = bufferClassSize(length + 1);
+  connection->pipelineLength = length;
+  memcpy(connection->pipeline, connection->buffer + requestLength, length + 1); /* with '\0' */
+  if (connection->bufferSize < bufferClassSize(PIPELINE_BUFFER_SIZE))
+  {
+    char * answers = allocBuffer(&bufferPool, PIPELINE_BUFFER_SIZE);
+    if (answers != NULL)
+    {
+      releaseBuffer(&bufferPool, connection->buffer, connection->bufferSize);
+      connection->buffer = answers;
+      connection->bufferSize = bufferClassSize(PIPELINE_BUFFER_SIZE);
+    }
+  }
+  return 1;
+}
+
+/**
+ * Takes the next complete GET or HEAD request out of the pipeline.
+ * \param connection The connection with pipelined requests.
+ * \param fileRequest Receives the request, see \a describeFileRequest.
+ * \returns 1 if a request was taken, 0 if there is none (or one that is
+ * not a GET or HEAD request, is invalid or has a body, which is handled
+ * from the receive buffer later).
+ */
+int takePipelinedRequest(struct connectionType * const connection, struct fileRequest * fileRequest)
+{
+  struct httpRequest * request = &connection->request;
+  if (connection->pipelineLength == 0)
+    return 0;
+  initHttpRequest(request);
+  if (parseHttpRequest(request, connection->pipeline, connection->pipelineLength) != httpComplete
+      || !isFileMethod(request) || requestContentLength(request) != 0
+      || !describeFileRequest(request, fileRequest))
+  {
+    initHttpRequest(request);
+    return 0;
+  }
+  countRequest(connection, requestKeepAlive(request));
+  unsigned int requestLength = request->length;
+  initHttpRequest(request);
+  connection->pipelineLength -= requestLength;
+  if (connection->pipelineLength == 0)
+  {
+    releaseBuffer(&bufferPool, connection->pipeline, connection->pipelineSize);
+    connection->pipeline = NULL;
+    connection->pipelineSize = 0;
+  }
+  else
+    memmove(connection->pipeline, connection->pipeline + requestLength, connection->pipelineLength + 1);
+  return 1;
+}
+
+/**
+ * Hands a file system call for a connection to the worker threads. The
+ * connection waits without events until the job is done.
+ * \param connection The connection.
+ * \param job The job, it belongs to the workers until it is completed.
+ */
+void submitFileJob(struct connectionType * const connection, struct fileJob * job)
+{
+  job->connection = connection;
+  ++connection->pendingOps;
+#ifdef HAVE_IO_URING
+  /* nothing is in flight for it meanwhile, a watch could outlive the job */
+  if (eventBackend == backendUring)
+    armConnectionTimer(connection);
+  else
+#endif
+    setConnectionEvents(connection, 0);
+  submitJob(&fileWorkers, &job->job, &fileJobCompletions);
+}
+
+/**
+ * Opens the file of a request in a worker thread if it is not cached:
+ * opening and loading it may block on the disk.
+ * \param connection The connection to answer on.
+ * \param request The request.
+ * \returns 1 if the connection waits for the worker, 0 if the file is opened right away.
+ */
+int openFileInWorker(struct connectionType * const connection, const struct fileRequest * request)
+{
+  if (fileWorkers.threadCount == 0 || preloadDocuments
+      || strcmp(request->filepath + strlen(documentRoot), STATUS_URL) == 0
+      || findCachedFile(&fileCache, request->filepath) != NULL)
+    return 0;
+  struct fileJob * job = (struct fileJob *)allocBuffer(&bufferPool, sizeof(struct fileJob));
+  if (job == NULL)
+    return 0;
+  job->type = fileJobOpen;
+  memcpy(&job->request, request, sizeof(struct fileRequest));
+  job->cache = &fileCache;
+  job->generation = fileCache.generation;
+  job->file = 0;
+  job->fd = -1;
+  connection->status = statusOutgoingAnswer;
+  submitFileJob(connection, job);
+  return 1;
+}
+
+/**
+ * Prepares the answer to a request and appends the answers to further
+ * pipelined requests while they fit, then starts sending. An answer from a
+ * file that is not cached waits for a worker to open it, the preparation
+ * continues from there.
+ * \param connection The connection, its buffer holds the answers prepared so far.
+ * \param request The request to answer first, receives the pipelined ones.
+ */
+void prepareAnswers(struct connectionType * const connection, struct fileRequest * request)
+{
+  for (;;)
+  {
+    if (openedFile == NULL && openFileInWorker(connection, request))
+      return;
+    bufferAnswer(connection, request);
+    if (hasFile(connection) || !connection->keepAlive
+        || connection->bufferSize - connection->bufferLength < ANSWER_RESERVE
+        || !takePipelinedRequest(connection, request))
+      break;
+  }
+  /* prepare connection for sending */
+  connection->status = statusOutgoingAnswer;
+  setConnectionEvents(connection, POLLOUT);
+  preparedAnswer = connection;
+}
+
+/**
+ * Acts on the input collected in the buffer: as soon as a request is
+ * complete, its answer is prepared. Small answers to further pipelined
+ * requests are appended, so they go out together, in request order.
+ * \param connection The connection whose buffer holds the input.
+ * \returns 1 if the connection is still open and waiting for more input, 0 otherwise.
+ */
+int handleBufferedInput(struct connectionType * const connection)
+{
+  if (connection->status == statusChatSender)
+  {
+    /* the body deadline restarts with every chunk */
+    armConnectionTimer(connection);
+    return !checkChatMessageComplete(connection);
+  }
+  if (connection->status != statusIncomingRequest)
+    return 1;
+  struct httpRequest * request = &connection->request;
+  /* resumes behind the bytes parsed before */
+  httpParseResult parsed = parseHttpRequest(request, connection->buffer, connection->bufferFreeOffset);
+  if (parsed == httpIncomplete)
+    return 1;
+  struct fileRequest fileRequest;
+  int contentLength = requestContentLength(request);
+  /* the body of a file request is not used, but skipped: it must not pass for the next request */
+  if (parsed == httpInvalid || contentLength < 0
+      || (!isChatRequest(request) && (!describeFileRequest(request, &fileRequest)
+                                      || request->length + contentLength >= MAX_BUFFER_SIZE)))
+  {
+    doLog(errorLog, "400 Bad Request");
+    connection->keepAlive = 0;
+    connection->bufferFreeOffset = 0;
+    connection->bufferLength = 0;
+    bufferHeaders(connection, 400, 0, 0, 0, 0);
+    connection->status = statusOutgoingAnswer;
+    setConnectionEvents(connection, POLLOUT);
+    return 0;
+  }
+  if (!isChatRequest(request) && connection->bufferFreeOffset < request->length + contentLength)
+  {
+    /* the body deadline restarts with every chunk */
+    armConnectionTimer(connection);
+    return 1;
+  }
+  countRequest(connection, requestKeepAlive(request));
+  if (isChatRequest(request)) /* chat service accessed */
+  {
+    if (contentLength == 0)
+    {
+      /* messages are pushed as they come, see countRequest for kept-alive ones */
+      if (!connection->keepAlive)
+      {
+        int one = 1;
+        setsockopt(connection->socketFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      }
+      connection->status = statusChatReceiver;
+      /* parked until the next message, it does not need a buffer meanwhile */
+      detachBuffer(connection);
+      setConnectionEvents(connection, 0);
+      return 0;
+    }
+    connection->status = statusChatSender;
+    connection->body = connection->buffer + request->length;
+    connection->contentLength = contentLength;
+    armConnectionTimer(connection);
+    return !checkChatMessageComplete(connection);
+  }
+  int methodAllowed = isFileMethod(request);
+  /* the request has been evaluated, its views are not needed any more */
+  if (!stashPipelinedRequests(connection, request->length + contentLength))
+    return 0;
+  initHttpRequest(request);
+  connection->bufferFreeOffset = 0;
+  connection->bufferLength = 0;
+  if (!methodAllowed)
+  {
+    doLog(errorLog, "405 Method Not Allowed");
+    bufferHeaders(connection, 405, 0, 0, 0, "Allow: GET, HEAD\r\n");
+    connection->status = statusOutgoingAnswer;
+    setConnectionEvents(connection, POLLOUT);
+    preparedAnswer = connection;
+    return 0;
+  }
+  prepareAnswers(connection, &fileRequest);
+  return 0;
+}
+
+/**
+ * Initialize the actions resulting from newly received data.
+ * \param connection The connection the data was received on.
+ * \param length The number of bytes appended to the buffer, 0 if the client closed the connection.
+ * \returns 1 if the connection is still open and waiting for more input, 0 otherwise.
+ */
+int processReceivedData(struct connectionType * const connection, int length)
+{
+  if (length == 0)
+  {
+#ifdef DEBUG
+    puts("Connection closed by client");
+#endif
+    closeConnection(connection);
+    return 0;
+  }
+  int wasIdle = connection->bufferFreeOffset == 0;
+  connection->bufferFreeOffset += length;
+  connection->buffer[connection->bufferFreeOffset]='\0';
+  /* a kept-alive connection starts its next request, the header deadline applies */
+  if (connection->status == statusIncomingRequest && wasIdle && connection->requestCount > 0)
+    armConnectionTimer(connection);
+  return handleBufferedInput(connection);
+}
+
+/**
+ * Read from a given connection and initialize resulting actions.
+ * \param connection The connection to read from
+ * \returns 1 if the connection is still open and waiting for more input, 0 otherwise.
+ */
+int receiveConnection(struct connectionType * const connection)
+{
+  if (!ensureReceiveSpace(connection))
+    return 0;
+  /* receive Message */
+  int length = receiveMessage(connection->socketFd, connection->buffer + connection->bufferFreeOffset, connection->bufferSize - connection->bufferFreeOffset - 1);
+  if (length == -1)
+  {
+    /* on EAGAIN the socket stays watched for POLLIN */
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      abortConnection(connection, "receiving from client", errno);
+    return 0;
+  }
+  return processReceivedData(connection, length);
+}
+
+/**
+ * Completes an answer. Kept-alive connections wait for their next request,
+ * all others are closed.
+ * \param connection The connection whose answer has been sent.
+ */
+void finishAnswer(struct connectionType * const connection)
+{
+  if (!connection->keepAlive)
+  {
+    closeConnection(connection);
+    return;
+  }
+  closeFile(connection);
+  releaseBuffer(&bufferPool, (char *)connection->multipart, sizeof(struct multipartAnswer));
+  connection->multipart = NULL;
+  connection->bufferFreeOffset = 0;
+  connection->bufferLength = 0;
+  connection->body = NULL;
+  connection->contentLength = 0;
+  initHttpRequest(&connection->request);
+  connection->status = statusIncomingRequest;
+  if (connection->pipelineLength > 0)
+  {
+    /* the pipelined requests become the receive buffer */
+    releaseBuffer(&bufferPool, connection->buffer, connection->bufferSize);
+    connection->buffer = connection->pipeline;
+    connection->bufferSize = connection->pipelineSize;
+    connection->bufferFreeOffset = connection->pipelineLength;
+    connection->pipeline = NULL;
+    connection->pipelineSize = 0;
+    connection->pipelineLength = 0;
+    if (!handleBufferedInput(connection) || !ensureReceiveSpace(connection))
+      return;
+  }
+  else
+    shrinkFileBuffer(connection);
+  setConnectionEvents(connection, POLLIN);
+}
+
+/**
+ * Takes a piece of the connection's file that was read into the buffer.
+ * \param connection The connection whose buffer has been sent completely.
+ * \param length The result of the read, -1 on errors.
+ * \param error The errno value of a failed read.
+ * \returns 1 if the buffer holds new data, 0 if the answer is complete or
+ * the connection was closed.
+ */
+int takeFileChunk(struct connectionType * const connection, long length, int error)
+{
+  if (length == -1)
+  {
+    abortConnection(connection, "reading file", error);
+    return 0;
+  }
+  if (length > 0)
+  {
+    connection->bufferFreeOffset = 0;
+    connection->bufferLength = length;
+    connection->fileOffset += length;
+    if (connection->fileRemaining > 0)
+      connection->fileRemaining -= length;
+    prefetchFileChunk(connection, fileChunkSize(connection));
+    return 1;
+  }
+  if (connection->fileRemaining > 0) /* file shrank, the announced length is wrong */
+    closeConnection(connection);
+  else /* eof */
+    finishAnswer(connection);
+  return 0;
+}
+
+/**
+ * Reads from the connection's file in a worker thread, into the buffer or
+ * only into the page cache.
+ * \param connection The connection, its buffer has been sent completely.
+ * \param type \a fileJobRead or \a fileJobPrefetch.
+ * \param length Number of bytes to read.
+ * \returns 1 if the connection waits for the worker, 0 if there is no memory for the job.
+ */
+int readFileInWorker(struct connectionType * const connection, fileJobType type, long length)
+{
+  struct fileJob * job = (struct fileJob *)allocBuffer(&bufferPool, sizeof(struct fileJob));
+  if (job == NULL)
+    return 0;
+  job->type = type;
+  job->fd = connection->fileFd;
+  job->buffer = connection->buffer;
+  job->bufferSize = connection->bufferSize;
+  job->offset = connection->fileOffset;
+  job->length = length;
+  submitFileJob(connection, job);
+  return 1;
+}
+
+/**
+ * Refills the sent buffer from the connection's file, but not beyond the
+ * announced length. What is not in the page cache is read by a worker.
+ * \param connection The connection whose buffer has been sent completely.
+ * \returns 1 if the buffer holds new data, 0 if the answer is complete,
+ * the connection was closed or waits for a worker.
+ */
+int refillBufferFromFile(struct connectionType * const connection)
+{
+  provideFileBuffer(connection);
+  unsigned int size = fileChunkSize(connection);
+#ifdef RWF_NOWAIT
+  if (fileWorkers.threadCount > 0)
+  {
+    struct iovec piece;
+    piece.iov_base = connection->buffer;
+    piece.iov_len = size;
+    long len = preadv2(connection->fileFd, &piece, 1, connection->fileOffset, RWF_NOWAIT);
+    if (len == -1 && errno == EAGAIN && readFileInWorker(connection, fileJobRead, size))
+      return 0;
+    /* file systems without support are read the usual way */
+    if (len != -1 || (errno != EAGAIN && errno != EOPNOTSUPP))
+      return takeFileChunk(connection, len, errno);
+  }
+#endif
+  long len = pread(connection->fileFd, connection->buffer, size, connection->fileOffset);
+  return takeFileChunk(connection, len, errno);
+}
+
+#if defined(HAVE_SENDFILE) && defined(RWF_NOWAIT)
+/**
+ * Checks whether sendfile can take the next piece of the connection's file
+ * from the page cache. Only its first byte is checked, a prefetch reads
+ * the whole piece.
+ * \param connection The connection sending a file.
+ * \returns 0 if it would wait for the disk, 1 otherwise.
+ */
+int fileChunkCached(const struct connectionType * const connection)
+{
+  char byte;
+  struct iovec piece;
+  piece.iov_base = &byte;
+  piece.iov_len = 1;
+  return preadv2(connection->fileFd, &piece, 1, connection->fileOffset, RWF_NOWAIT) != -1
+         || errno != EAGAIN;
+}
+#endif
+
+#ifdef HAVE_SENDFILE
+/**
+ * Sends the next piece of the connection's file from the page cache to
+ * the socket, without copying it through the buffer.
+ * \param connection The connection whose buffer has been sent completely.
+ * \returns 1 if something was sent (or buffered, for files sendfile cannot
+ * handle), 0 if the socket would block or the connection was closed, and
+ * -1 on errors (errno is set).
+ */
+int sendFileChunk(struct connectionType * const connection)
+{
+  size_t chunk = SENDFILE_CHUNK_SIZE;
+  if (connection->fileRemaining >= 0 && connection->fileRemaining < (long)chunk)
+    chunk = connection->fileRemaining;
+#ifdef RWF_NOWAIT
+  if (fileWorkers.threadCount > 0 && !fileChunkCached(connection))
+  {
+    /* the worker reads through the idle buffer */
+    provideFileBuffer(connection);
+    if (readFileInWorker(connection, fileJobPrefetch, chunk))
+      return 0;
+  }
+#endif
+  off_t offset = connection->fileOffset;
+  ssize_t sent = sendfile(connection->socketFd, connection->fileFd, &offset, chunk);
+  if (sent == -1)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    if (errno == EINVAL || errno == ENOSYS)
+      return refillBufferFromFile(connection);
+    return -1;
+  }
+  if (sent == 0)
+  {
+    if (connection->fileRemaining > 0) /* file shrank, the announced length is wrong */
+    {
+      closeConnection(connection);
+      return 0;
+    }
+    connection->fileRemaining = 0; /* eof */
+    return 1;
+  }
+  connection->fileOffset += sent;
+  if (connection->fileRemaining > 0)
+    connection->fileRemaining -= sent;
+  return 1;
+}
+#endif
+
+/**
+ * Sends the next piece of information over the network
+ * \param connection The connection over which the information is to be sent
+ * \returns 1 if the connection is still open and might accept more data, 0 otherwise.
+ */
+int sendConnection(struct connectionType * const connection)
+{
+  int result;
+#ifdef HAVE_SENDFILE
+  if (!fileInMemory(connection) && connection->bufferFreeOffset == connection->bufferLength)
+    /* the headers are out, the rest of the file goes out directly */
+    result = sendFileChunk(connection);
+  else
+#endif
+    /* with the file behind the buffer if it is in memory */
+    result = sendBuffer(connection);
+  if (result == -1)
+    abortConnection(connection, "sending to client", errno);
+  /* on EAGAIN the socket stays watched for POLLOUT */
+  if (result <= 0)
+    return 0;
+  /* the client is reading, give it another write timeout */
+  armConnectionTimer(connection);
+  if (connection->bufferFreeOffset < connection->bufferLength || startNextPart(connection))
+    return 1;
+  if (!hasFile(connection) || connection->fileRemaining == 0)
+  {
+    finishAnswer(connection);
+    return 0;
+  }
+#ifndef HAVE_SENDFILE
+  if (!fileInMemory(connection))
+    return refillBufferFromFile(connection);
+#endif
+  connection->bufferFreeOffset = 0;
+  connection->bufferLength = 0;
+  return 1;
+}
+
+/**
+ * Runs a file job in a worker thread. It only touches the file and the
+ * buffer it was given.
+ * \param workerJob The job, embedded into a \a fileJob.
+ */
+void runFileJob(struct workerJob * workerJob)
+{
+  struct fileJob * job = (struct fileJob *)workerJob;
+  long done = 0;
+  ssize_t len = 1;
+  switch (job->type)
+  {
+    case fileJobOpen:
+      job->file = loadCachedFile(job->cache, job->request.filepath, &job->fd);
+      break;
+    case fileJobRead:
+      job->result = pread(job->fd, job->buffer, job->length, job->offset);
+      job->error = errno;
+      break;
+    case fileJobPrefetch:
+      /* the content is not needed, only the pages it leaves in the page cache */
+      while (done < job->length && len > 0)
+      {
+        len = pread(job->fd, job->buffer,
+                    job->length - done < (long)job->bufferSize ? job->length - done : (long)job->bufferSize,
+                    job->offset + done);
+        if (len > 0)
+          done += len;
+      }
+      break;
+  }
+}
+
+/**
+ * Continues a connection after a worker did its file job.
+ * \param job The job, it is released.
+ */
+void completeFileJob(struct fileJob * job)
+{
+  struct connectionType * connection = job->connection;
+  --connection->pendingOps;
+  if (connection->status == statusClosed)
+  {
+    /* deferred close, see closeConnection; an opened file may still serve others */
+    if (job->type == fileJobOpen)
+    {
+      int fd = job->fd;
+      struct cachedFile * file = addCachedFile(&fileCache, job->file, job->generation, loopTime, &fd);
+      if (file != 0)
+        releaseCachedFile(file);
+      else if (fd != -1)
+        close(fd);
+    }
+    releaseBuffer(&bufferPool, (char *)job, sizeof(struct fileJob));
+    if (connection->pendingOps == 0)
+      releaseConnection(connection);
+    return;
+  }
+  struct fileRequest request;
+  switch (job->type)
+  {
+    case fileJobOpen:
+      /* the request lives in the job, which openAnswerFile releases */
+      memcpy(&request, &job->request, sizeof(struct fileRequest));
+      openedFile = job;
+      prepareAnswers(connection, &request);
+      return;
+    case fileJobRead:
+      if (takeFileChunk(connection, job->result, job->error))
+        setConnectionEvents(connection, POLLOUT);
+      break;
+    case fileJobPrefetch:
+      setConnectionEvents(connection, POLLOUT);
+      break;
+  }
+  releaseBuffer(&bufferPool, (char *)job, sizeof(struct fileJob));
+}
+
+/**
+ * Continues the connections whose file jobs the workers are done with.
+ */
+void completeFileJobs()
+{
+  struct workerJob * next = takeCompletedJobs(&fileJobCompletions);
+  while (next != 0)
+  {
+    struct fileJob * job = (struct fileJob *)next;
+    next = next->next;
+    completeFileJob(job);
+  }
+}
+
+/**
+ * Acts on a wakeup of this loop: distributes the chat log if another loop
+ * asked for it and continues the connections whose file jobs are done.
+ */
+void serveWakeup()
+{
+  if (__atomic_exchange_n(&currentLoop->chatPending, 0, __ATOMIC_ACQUIRE))
+    distributeChatLog();
+  completeFileJobs();
+}
+
+/**
+ * Handles a wakeup of this loop by another one or by a worker.
+ */
+void handleWakeup()
+{
+  uint64_t count;
+  /* resets the eventfd counter, wakeups that raced with us are merged */
+  if (read(wakeupFd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    perror("Error reading wakeup fd");
+  serveWakeup();
+}
+
+/**
+ * Handles a connection whose deadline passed.
+ * A chat receiver gets an empty answer so that the client polls again,
+ * everybody else is disconnected.
+ * \param timer The timer embedded into the connection.
+ */
+void connectionTimedOut(struct timer * timer)
+{
+  struct connectionType * connection = (struct connectionType *)((char *)timer - offsetof(struct connectionType, timer));
+  if (connection->status == statusChatReceiver)
+  {
+    unparkConnection(connection);
+    if (!attachBuffer(connection))
+    {
+      closeConnection(connection);
+      return;
+    }
+    connection->fileFd = -1;
+    bufferHeaders(connection, 204, 0, 0, 0, 0);
+    connection->status = statusOutgoingAnswer;
+    setConnectionEvents(connection, POLLOUT);
+    return;
+  }
+  switch (connection->status)
+  {
+    case statusIncomingRequest:
+      /* an idle kept-alive connection is closed without further notice */
+      if (connection->requestCount == 0 || connection->bufferFreeOffset > 0)
+        doLog(errorLog, "Timeout while waiting for request headers");
+      break;
+    case statusChatSender:
+      doLog(errorLog, "Timeout while waiting for request body");
+      break;
+    default:
+      doLog(errorLog, "Timeout while sending answer");
+      break;
+  }
+  closeConnection(connection);
+}
+
+/**
+ * Checks whether this loop has room for another client.
+ * \returns 1 if the connection or the memory limit is reached, 0 otherwise.
+ */
+int loopOverloaded()
+{
+  if (connectionCount >= loopMaxConnections)
+    return 1;
+  /* a new client needs at least its object and a default buffer */
+  return loopMaxMemory > 0
+         && connectionPool.stats.usedBytes + bufferPool.stats.usedBytes
+            + sizeof(struct connectionType) + BUFFER_SIZE > loopMaxMemory;
+}
+
+/**
+ * Turns away a client we have no room for with the precomputed 503 answer.
+ * \param communicationSocket The socket of the client, it is closed.
+ */
+void rejectConnection(int communicationSocket)
+{
+  /* best effort: a fresh socket has room for these few bytes */
+  send(communicationSocket, serviceUnavailableAnswer, sizeof(serviceUnavailableAnswer) - 1,
+       MSG_DONTWAIT | MSG_NOSIGNAL);
+  close(communicationSocket);
+  STATS_ADD(sheddingStats.rejected, 1);
+}
+
+/**
+ * Stops watching the listening socket, new clients wait in the listen backlog.
+ */
+void pauseAccepting()
+{
+#ifdef DEBUG
+  puts("Overloaded, pausing accept");
+#endif
+  acceptPaused = 1;
+  STATS_ADD(sheddingStats.pauses, 1);
+  pollStruct[0].events = 0;
+#ifdef HAVE_EPOLL
+  if (eventBackend == backendEpoll)
+    updateEpoll(EPOLL_CTL_MOD, listeningSocket, 0, 0);
+#endif
+#ifdef HAVE_IO_URING
+  if (eventBackend == backendUring)
+    queueUringOperation(0, uringCancel);
+#endif
+}
+
+/**
+ * Watches the listening socket again once a paused loop has room.
+ * \returns 1 if accepting was resumed, 0 otherwise.
+ */
+int resumeAccepting()
+{
+  if (!acceptPaused || loopOverloaded())
+    return 0;
+#ifdef DEBUG
+  puts("Resuming accept");
+#endif
+  acceptPaused = 0;
+  pollStruct[0].events = POLLIN;
+#ifdef HAVE_EPOLL
+  /* rearming reports clients that are already waiting */
+  if (eventBackend == backendEpoll)
+    updateEpoll(EPOLL_CTL_MOD, listeningSocket, POLLIN, 0);
+#endif
+#ifdef HAVE_IO_URING
+  /* otherwise the cancelled one is restarted when it completes */
+  if (eventBackend == backendUring && !uringAcceptActive)
+    queueUringOperation(0, uringAccept);
+#endif
+  return 1;
+}
+
+/**
+ * Inserts a newly accepted client into all relevant data structures
+ * \param communicationSocket The socket of the new client.
+ */
+void addConnection(int communicationSocket)
+{
+  /* initialize new connection */
+  struct connectionType * newConnection = allocObject(&connectionPool);
+  if (newConnection == NULL || !attachBuffer(newConnection))
+  {
+    fputs("Error: No memory for new connection\n", stderr);
+    freeObject(&connectionPool, newConnection);
+    close(communicationSocket);
+    return;
+  }
+  newConnection->status = statusIncomingRequest;
+  newConnection->fileFd = -1;
+  newConnection->socketFd = communicationSocket;
+  initHttpRequest(&newConnection->request);
+  STATS_ADD(connectionCount, 1);
+
+  /* initialize poll struct */
+  if (nextFreePollStructIndex>=pollStructSize-1) /* no space left */
+    resizePollStruct(1);
+
+  /* claim the next slot */
+  newConnection->pollStructIndex = nextFreePollStructIndex;
+  pollStruct[nextFreePollStructIndex].fd = communicationSocket;
+  pollStruct[nextFreePollStructIndex].events = POLLIN;
+  connectionTable[nextFreePollStructIndex] = newConnection;
+  #ifdef DEBUG
+  printf("new revents: %d\n", pollStruct[nextFreePollStructIndex].revents);
+  #endif
+  ++nextFreePollStructIndex;
+  armConnectionTimer(newConnection);
+#ifdef HAVE_EPOLL
+  if (eventBackend == backendEpoll)
+    updateEpoll(EPOLL_CTL_ADD, communicationSocket, POLLIN, newConnection);
+#endif
+#ifdef HAVE_IO_URING
+  if (eventBackend == backendUring)
+    queueUringOperation(newConnection, uringRecv);
+#endif
+}
+
+/**
+ * Accepts the waiting clients on the \a listeningSocket until it would block
+ * and inserts the new connections into all relevant data structures.
+ * At most \a MAX_ACCEPTS_PER_ITERATION clients are accepted per call.
+ * At the loop's limits accepting is paused or the clients are rejected,
+ * depending on the \a overload policy.
+ * \returns 1 if the limit was hit and more clients might be waiting, 0 otherwise.
+ */
+int acceptNewConnections()
+{
+  int accepted;
+  for (accepted = 0; accepted < MAX_ACCEPTS_PER_ITERATION; ++accepted)
+  {
+    if (overload == overloadPause && loopOverloaded())
+    {
+      pauseAccepting();
+      return 0;
+    }
+    #ifdef DEBUG
+    puts("Accepting new connection");
+    fflush(stdout);
+    #endif
+    struct sockaddr_in remoteAddr;
+    socklen_t remoteAddrLength = sizeof(remoteAddr);
+    int communicationSocket = accept4(listeningSocket, (struct sockaddr*) &remoteAddr, &remoteAddrLength,
+                                      SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (communicationSocket == -1)
+    {
+      /* clients that gave up while waiting in the queue do not stop us */
+      if (errno == ECONNABORTED || errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        perror("Error accepting connection");
+      return 0;
+    }
+    if (loopOverloaded())
+      rejectConnection(communicationSocket);
+    else
+      addConnection(communicationSocket);
+  }
+  return 1;
+}
+
+/**
+ * Acts on the events reported for a single connection.
+ * \param connection The connection the events belong to.
+ * \param revents The events reported by the backend (in poll notation).
+ * \returns 1 if the connection is still open and might make further progress
+ * on the same events, 0 otherwise.
+ */
+int handleConnectionEvents(struct connectionType * const connection, short revents)
+{
+  /* no need to check the status because it corresponds to the active pollevents, which are a superset of the poll-r-events*/
+  short events = pollStruct[connection->pollStructIndex].events;
+  if (revents & (POLLHUP | POLLERR | POLLNVAL))
+  {
+  #ifdef DEBUG
+    puts("Received POLLHUP/POLLERR/POLLNVAL");
+  #endif
+    closeConnection(connection);
+    return 0;
+  }
+  else if (revents & events & POLLIN)
+  {
+    #ifdef DEBUG
+    puts("POLLIN");
+    #endif
+    preparedAnswer = 0;
+    int waiting = receiveConnection(connection);
+    /* the socket is most likely writable, the answer need not wait for the next round */
+    if (preparedAnswer == connection)
+      while (sendConnection(connection))
+        ;
+    return waiting;
+  }
+  else if (revents & events & POLLOUT)
+  {
+    #ifdef DEBUG
+    puts("POLLOUT");
+    #endif
+    if (connection->status == statusOutgoingAnswer)
+      return sendConnection(connection);
+  }
+  return 0;
+}
+
+/**
+ * Main Loop using poll: Handle all incoming traffic
+ */
+void talkToClientsPoll()
+{
+  int result;
+  while (!__atomic_load_n(&stopRequested, __ATOMIC_RELAXED))
+  {
+    #ifdef DEBUG
+    /*puts("new poll run");*/
+    #endif
+    result = poll(pollStruct, pollStructSize, nextTimerTimeout(&timerWheel, loopTime));
+    if (result == -1 && errno == EINTR)
+      continue;
+    exitIfError(result, "Error on polling");
+    loopTime = currentTimeMs();
+    if (result > 0)
+    {
+      #ifdef DEBUG
+      puts("result > 0");
+      fflush(stdout);
+      #endif
+      if (pollStruct[0].revents & POLLIN)
+      {
+        /* new callers on the listening socket */
+        acceptNewConnections();
+      }
+      if (pollStruct[1].revents & POLLIN)
+        handleWakeup();
+#ifdef HAVE_INOTIFY
+      /* before the requests, which may be for the changed files */
+      if (pollStruct[2].revents & POLLIN)
+        handleDirectoryChanges();
+#endif
+      /*
+       * walk backwards: closing a connection moves the last one into its
+       * slot, which has been handled already
+       */
+      int i;
+      for (i = nextFreePollStructIndex - 1; i >= RESERVED_POLL_SLOTS; --i)
+      {
+        /* idle connections are not even touched */
+        if (pollStruct[i].revents == 0)
+          continue;
+        #ifdef DEBUG
+        puts("itRun");
+        #endif
+        handleConnectionEvents(connectionTable[i], pollStruct[i].revents);
+      }
+    }
+    #ifdef DEBUG
+    else
+    {
+      puts("result == 0");
+      fflush(stdout);
+    }
+    #endif
+    advanceTimerWheel(&timerWheel, loopTime, connectionTimedOut);
+    resumeAccepting();
+  }
+}
+
+#ifdef HAVE_EPOLL
+/**
+ * Main Loop using edge-triggered epoll: Handle all incoming traffic,
+ * touching only the connections that are actually ready.
+ */
+void talkToClientsEpoll()
+{
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  int result;
+  int i;
+  /* set while clients may still wait in the accept queue */
+  int listenerReady = 0;
+  while (!__atomic_load_n(&stopRequested, __ATOMIC_RELAXED))
+  {
+    result = epoll_wait(epollFd, events, EPOLL_MAX_EVENTS,
+                        listenerReady ? 0 : nextTimerTimeout(&timerWheel, loopTime));
+    if (result == -1 && errno == EINTR)
+      continue;
+    exitIfError(result, "Error on epoll_wait");
+    loopTime = currentTimeMs();
+    for (i = 0; i < result; ++i)
+    {
+      struct connectionType * connection = events[i].data.ptr;
+      if (connection == 0)
+      {
+        /* new callers on the listening socket, accepted below */
+        listenerReady = 1;
+        continue;
+      }
+      if (connection == (struct connectionType *)&wakeupFd)
+      {
+        handleWakeup();
+        continue;
+      }
+#ifdef HAVE_INOTIFY
+      if (connection == (struct connectionType *)&directoryWatch)
+      {
+        handleDirectoryChanges();
+        continue;
+      }
+#endif
+      short revents = 0;
+      if (events[i].events & EPOLLIN)
+        revents |= POLLIN;
+      if (events[i].events & EPOLLOUT)
+        revents |= POLLOUT;
+      if (events[i].events & EPOLLHUP)
+        revents |= POLLHUP;
+      if (events[i].events & EPOLLERR)
+        revents |= POLLERR;
+      /* edge-triggered: keep going until the socket would block */
+      while (handleConnectionEvents(connection, revents));
+    }
+    /* edge-triggered: there is no new event for clients we leave in the queue */
+    if (listenerReady)
+      listenerReady = acceptNewConnections();
+    advanceTimerWheel(&timerWheel, loopTime, connectionTimedOut);
+    listenerReady |= resumeAccepting();
+  }
+}
+#endif
+
+#ifdef HAVE_IO_URING
+/**
+ * Queues the next operation of an answer after a piece of it was sent:
+ * the rest of the buffer, the next piece of the file or nothing when the
+ * answer is complete.
+ * \param connection The connection sending the answer.
+ */
+void continueUringAnswer(struct connectionType * const connection)
+{
+  if (connection->bufferFreeOffset < connection->bufferLength || startNextPart(connection))
+    queueUringOperation(connection, uringSend);
+  else if (!hasFile(connection) || connection->fileRemaining == 0)
+    finishAnswer(connection);
+  else if (fileInMemory(connection))
+    queueUringOperation(connection, uringSendCached);
+  else
+  {
+    provideFileBuffer(connection);
+    queueUringOperation(connection, uringRead);
+  }
+}
+
+/**
+ * Continues the state machine of a connection after one of its io_uring
+ * operations completed.
+ * \param cqe The completion of the operation.
+ */
+void completeUringOperation(const struct io_uring_cqe * cqe)
+{
+  uringOpType op = cqe->user_data & URING_OP_MASK;
+  struct connectionType * connection = (struct connectionType *)(unsigned long)(cqe->user_data & ~(__u64)URING_OP_MASK);
+  if (op == uringWakeup)
+  {
+    serveWakeup();
+    queueUringOperation(0, uringWakeup);
+    return;
+  }
+  if (op == uringAccept)
+  {
+    if (cqe->res >= 0)
+    {
+      /* clients may still arrive while the cancellation is in flight */
+      if (loopOverloaded())
+        rejectConnection(cqe->res);
+      else
+      {
+        addConnection(cqe->res);
+        if (overload == overloadPause && loopOverloaded())
+          pauseAccepting();
+      }
+    }
+    else if (cqe->res == -EINVAL)
+    {
+      fputs("Error: Kernel does not support multishot accept\n", stderr);
+      exit(1);
+    }
+    /* the kernel ends multishot requests on errors, restart it unless we paused it */
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+      uringAcceptActive = 0;
+      if (!acceptPaused)
+        queueUringOperation(0, uringAccept);
+    }
+    return;
+  }
+  if (op == uringCancel && connection == 0)
+    return;
+#ifdef HAVE_INOTIFY
+  if (op == uringWatch && connection == 0)
+  {
+    handleDirectoryChanges();
+    queueUringOperation(0, uringWatch);
+    return;
+  }
+#endif
+
+  --connection->pendingOps;
+  if (connection->status == statusClosed)
+  {
+    /* deferred close, see closeConnection */
+    if (connection->pendingOps == 0)
+      releaseConnection(connection);
+    return;
+  }
+  switch (op)
+  {
+    case uringRecv:
+      if (cqe->res < 0)
+        abortConnection(connection, "receiving from client", -cqe->res);
+      else if (processReceivedData(connection, cqe->res) && ensureReceiveSpace(connection))
+        queueUringOperation(connection, uringRecv);
+      break;
+    case uringSend:
+      if (cqe->res < 0)
+      {
+        abortConnection(connection, "sending to client", -cqe->res);
+        break;
+      }
+      if (cqe->res == 0)
+      {
+        closeConnection(connection);
+        break;
+      }
+      advanceAnswer(connection, cqe->res);
+      armConnectionTimer(connection);
+      continueUringAnswer(connection);
+      break;
+    case uringSendCached:
+      if (cqe->res < 0)
+      {
+        abortConnection(connection, "sending to client", -cqe->res);
+        break;
       }
-      else /* chat service accessed */
+      if (cqe->res == 0)
       {
-        if (result.contentLength == 0)
-        {
-          connection->status = statusChatReceiver;
-          pollStruct[connection->pollStructIndex].events = 0;
-        }
-        else
-        {
-          connection->status = statusChatSender;
-          connection->body = result.body;
-          connection->contentLength = result.contentLength;
-          checkChatMessageComplete(connection);
-        }
+        closeConnection(connection);
+        break;
       }
-    }
-    else if (connection->status == statusChatSender)
-      checkChatMessageComplete(connection);
+      connection->fileOffset += cqe->res;
+      connection->fileRemaining -= cqe->res;
+      armConnectionTimer(connection);
+      continueUringAnswer(connection);
+      break;
+    case uringRead:
+      if (takeFileChunk(connection, cqe->res < 0 ? -1 : cqe->res, -cqe->res))
+        queueUringOperation(connection, uringSend);
+      break;
+    case uringWatch:
+      /* a parked chat receiver is not supposed to talk to us, the watch of an earlier park was cancelled */
+      if (cqe->res != -ECANCELED && connection->status == statusChatReceiver)
+        closeConnection(connection);
+      break;
+    default:
+      break;
   }
 }
 
 /**
- * Accepts a new client on the \a listeningSocket and inserts the new connection into all relevant data structures
+ * Main Loop using io_uring: Submits all operations queued during the last
+ * round with a single system call and advances the connections whose
+ * operations completed.
  */
-void acceptNewConnection()
+void talkToClientsUring()
 {
-  #ifdef DEBUG
-  puts("Accepting new connection");
-  fflush(stdout);
-  #endif
-  /* accept connections */
-  struct sockaddr_in remoteAddr;
-  socklen_t remoteAddrLength = sizeof(remoteAddr);
-  int communicationSocket = accept(listeningSocket, (struct sockaddr*) &remoteAddr, &remoteAddrLength);
-  if (communicationSocket == -1)
-    perror("Error accepting connection");
-  else
+  struct io_uring_cqe * cqe;
+  while (!__atomic_load_n(&stopRequested, __ATOMIC_RELAXED))
   {
-    /* initialize new connection */
-    struct connectionType * newConnection = malloc(sizeof(struct connectionType));
-    memset(newConnection, 0, sizeof(struct connectionType));
-    newConnection->status = statusIncomingRequest;
-    newConnection->fileFd = -1;
-    newConnection->socketFd = communicationSocket;
-    newConnection->buffer = calloc(BUFFER_SIZE, sizeof(char));
-    newConnection->bufferSize = BUFFER_SIZE;
-
-    /* initialize poll struct */
-    if (nextFreePollStructIndex>=pollStructSize-1) /* no space left */
-      resizePollStruct(1);
-
-    /* claim the next slot */
-    newConnection->pollStructIndex = nextFreePollStructIndex;
-    pollStruct[nextFreePollStructIndex].fd = communicationSocket;
-    pollStruct[nextFreePollStructIndex].events = POLLIN;
-    #ifdef DEBUG
-    printf("new revents: %d\n", pollStruct[nextFreePollStructIndex].revents);
-    #endif
-    ++nextFreePollStructIndex;
-
-    /* insert into connection list */
-    if (connectionTail == 0) /* no connection yet */
-      connectionTail = connectionHead = newConnection;
-    else
+    /* EBUSY: completions are backing up, reap them first; ETIME: a deadline is due */
+    if (submitUring(&ring, 1, nextTimerTimeout(&timerWheel, loopTime)) == -1
+        && errno != EBUSY && errno != ETIME)
+    {
+      perror("Error submitting to io_uring");
+      exit(1);
+    }
+    loopTime = currentTimeMs();
+    while ((cqe = peekUringCqe(&ring)) != 0)
     {
-      /* put it at the end of the list */
-      newConnection->prev = connectionTail;
-      connectionTail->next = newConnection;
-      connectionTail = newConnection;
+      /* copy it, the kernel may reuse the slot once we advance */
+      struct io_uring_cqe completion = *cqe;
+      advanceUringCq(&ring);
+      completeUringOperation(&completion);
     }
+    advanceTimerWheel(&timerWheel, loopTime, connectionTimedOut);
+    resumeAccepting();
   }
 }
+#endif
 
 /**
- * Main Loop: Handle all incoming traffic
+ * Main Loop: Handle all incoming traffic with the selected backend until
+ * the server is stopped
  */
 void talkToClients()
 {
-  int result;
-  for (;;)
+#ifdef HAVE_EPOLL
+  if (eventBackend == backendEpoll)
   {
-    #ifdef DEBUG
-    /*puts("new poll run");*/
-    #endif
-    result = poll(pollStruct, pollStructSize, -1);
-    exitIfError(result, "Error on polling");
-    if (result > 0)
+    talkToClientsEpoll();
+    return;
+  }
+#endif
+#ifdef HAVE_IO_URING
+  if (eventBackend == backendUring)
+  {
+    talkToClientsUring();
+    return;
+  }
+#endif
+  talkToClientsPoll();
+}
+
+/**
+ * Closes all connections of a stopped event loop and waits until io_uring
+ * and the workers are done with them, so that they can be freed.
+ */
+void drainEventLoop()
+{
+#ifdef HAVE_IO_URING
+  /* clients accepted from now on are turned away below */
+  if (eventBackend == backendUring && uringAcceptActive)
+    queueUringOperation(0, uringCancel);
+#endif
+  acceptPaused = 1;
+  while (nextFreePollStructIndex > RESERVED_POLL_SLOTS)
+    closeConnection(connectionTable[nextFreePollStructIndex - 1]);
+  while (connectionCount > 0)
+  {
+#ifdef HAVE_IO_URING
+    if (eventBackend == backendUring)
     {
-      #ifdef DEBUG
-      puts("result > 0");
-      fflush(stdout);
-      #endif
-      if (pollStruct[0].revents & POLLIN)
-      {
-        /* new caller on the listening socket */
-        acceptNewConnection();
-      }
-      struct connectionType * conIt = connectionHead;
-      struct connectionType * next;
-      while (conIt != 0)
+      struct io_uring_cqe * cqe;
+      if (submitUring(&ring, 1, -1) == -1 && errno != EBUSY)
+        break;
+      while ((cqe = peekUringCqe(&ring)) != 0)
       {
-        /* conIt might be disposed */
-        next = conIt->next;
-        #ifdef DEBUG
-        puts("itRun");
-        #endif
-        /* no need to check conIt->status because it corresponds to the active pollevents, which are a superset of the poll-r-events*/
-        if (pollStruct[conIt->pollStructIndex].revents & (POLLHUP | POLLERR | POLLNVAL))
-        {
-        #ifdef DEBUG
-          puts("Received POLLHUP/POLLERR/POLLNVAL");
-        #endif
-          closeConnection(conIt);
-        }
-        else if (pollStruct[conIt->pollStructIndex].revents & POLLIN)
-        {
-          #ifdef DEBUG
-          puts("POLLIN");
-          #endif
-          receiveConnection(conIt);
-        }
-        else if (pollStruct[conIt->pollStructIndex].revents & POLLOUT)
-        {
-          #ifdef DEBUG
-          puts("POLLOUT");
-          #endif
-          if (conIt->status == statusOutgoingAnswer)
-            sendConnection(conIt);
-        }
-        conIt = next;
+        struct io_uring_cqe completion = *cqe;
+        advanceUringCq(&ring);
+        if ((completion.user_data & URING_OP_MASK) == uringAccept && completion.res >= 0)
+          close(completion.res);
+        else
+          completeUringOperation(&completion);
       }
+      continue;
     }
-    #ifdef DEBUG
-    else
-    {
-      puts("result == 0");
-      fflush(stdout);
-    }
-    #endif
+#endif
+    /* only file jobs keep closed connections around */
+    struct pollfd wakeup;
+    wakeup.fd = wakeupFd;
+    wakeup.events = POLLIN;
+    if (poll(&wakeup, 1, -1) == -1 && errno != EINTR)
+      break;
+    handleWakeup();
+  }
+}
+
+/**
+ * Frees the resources of the event loop of the calling thread once it
+ * stopped. The logs are shared and freed by \a stopServer.
+ */
+void cleanUpEventLoop()
+{
+  drainEventLoop();
+  /* try to close the socket if necessary */
+  if (listeningSocket != -1)
+  {
+  #ifdef DEBUG
+    puts("Closing Socket on Exit.");
+  #endif
+    int result = close(listeningSocket);
+    if (result == -1)
+      perror("Error closing Socket");
   }
+#ifdef HAVE_IO_URING
+  if (eventBackend == backendUring)
+    freeUring(&ring);
+#endif
+  free(connectionTable);
+  free(pollStruct);
+  destroyObjectPool(&connectionPool);
+  destroyBufferPool(&bufferPool);
+  destroyFileCache(&fileCache);
+#ifdef HAVE_INOTIFY
+  destroyDirectoryWatch(&directoryWatch);
+#endif
+  if (epollFd != -1)
+    close(epollFd);
 }
 
 /**
@@ -741,23 +3557,26 @@ int resolvePort(char * service)
 }
 
 /**
- * Starts a server listing on a specified port
- * \param port_s The Port or service name to listen on
+ * Creates a socket listening on a specified port
+ * \param port The port (in network byte order) to listen on
+ * \returns The listening socket
  */
-void server(char * port_s)
+int openListeningSocket(int port)
 {
-  int port = resolvePort(port_s);
-  if (port == -1)
-    exit(1);
-
-  /* create socket */
-  listeningSocket = socket(AF_INET,SOCK_STREAM, 0);
+  /* create socket, accepting never blocks so we can drain the queue */
+  int listeningSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   exitIfError(listeningSocket, "Error creating socket");
 
   /* stop socket from blocking the port after disconnecting */
   int sockopt = 1;
   int result = setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEADDR, &sockopt, sizeof(sockopt));
   exitIfError(result, "Error setting socket options");
+  /* every loop gets its own socket, the kernel distributes the clients */
+  if (threadCount > 1)
+  {
+    result = setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof(sockopt));
+    exitIfError(result, "Error setting socket options");
+  }
 
   /* bind to port */
   struct sockaddr_in localAddr;
@@ -769,16 +3588,163 @@ void server(char * port_s)
   exitIfError(result, "Error binding to port");
 
   /* start listening */
-  result = listen(listeningSocket, 1); /* only one client allowed */
+  result = listen(listeningSocket, listenBacklog);
   exitIfError(result, "Error listening");
-  #ifdef DEBUG
-  puts("Server started, talking to clients");
-  #endif
+  return listeningSocket;
+}
+
+/**
+ * Sets up the thread local state of an event loop in the calling thread
+ * \param loop The loop to run in this thread
+ */
+void initEventLoop(struct eventLoop * loop)
+{
+  currentLoop = loop;
+  listeningSocket = loop->listeningSocket;
+  wakeupFd = loop->wakeupFd;
+  initCompletionQueue(&fileJobCompletions, wakeupFd);
+  /* init pools */
+  initObjectPool(&connectionPool, sizeof(struct connectionType), CONNECTIONS_PER_SLAB);
+  initBufferPool(&bufferPool, MAX_CACHED_BUFFER_BYTES);
+  loop->connectionPool = &connectionPool;
+  loop->bufferPool = &bufferPool;
+  /* every loop gets its share of the limits */
+  loopMaxConnections = (maxConnections + threadCount - 1) / threadCount;
+  loopMaxMemory = (maxMemory + threadCount - 1) / threadCount;
+  loop->sheddingStats = &sheddingStats;
+  loop->connectionCount = &connectionCount;
+  initFileCache(&fileCache, (fileCacheSize + threadCount - 1) / threadCount,
+                (openFiles + threadCount - 1) / threadCount, fileCacheValid);
+  loop->fileCache = &fileCache;
+#ifdef HAVE_INOTIFY
+  /* snapshots are not cached files, they change on SIGHUP only */
+  if (watchDocuments && !preloadDocuments)
+    startDirectoryWatch();
+#endif
+  /* init deadlines */
+  loopTime = currentTimeMs();
+  initTimerWheel(&timerWheel, loopTime);
   /* init poll struct */
-  pollStructSize = 1 + INITIAL_FREE_SLOTS_IN_POLLSTRUCT;
+  pollStructSize = RESERVED_POLL_SLOTS + INITIAL_FREE_SLOTS_IN_POLLSTRUCT;
   pollStruct = calloc(pollStructSize, sizeof(struct pollfd));
+  connectionTable = calloc(pollStructSize, sizeof(struct connectionType *));
+  if (pollStruct == NULL || connectionTable == NULL)
+  {
+    fputs("Could not allocate pollstruct", stderr);
+    exit(1);
+  }
   pollStruct[0].fd = listeningSocket;
   pollStruct[0].events = POLLIN;
+  pollStruct[1].fd = wakeupFd;
+  pollStruct[1].events = POLLIN;
+  pollStruct[2].fd = -1;
+  pollStruct[2].events = POLLIN;
+#ifdef HAVE_INOTIFY
+  pollStruct[2].fd = directoryWatch.fd;
+#endif
+#ifdef HAVE_EPOLL
+  /* init epoll set */
+  if (eventBackend == backendEpoll)
+  {
+    epollFd = epoll_create(1);
+    exitIfError(epollFd, "Error creating epoll instance");
+    updateEpoll(EPOLL_CTL_ADD, listeningSocket, POLLIN, 0);
+    updateEpoll(EPOLL_CTL_ADD, wakeupFd, POLLIN, (struct connectionType *)&wakeupFd);
+#ifdef HAVE_INOTIFY
+    if (directoryWatch.fd != -1)
+      updateEpoll(EPOLL_CTL_ADD, directoryWatch.fd, POLLIN, (struct connectionType *)&directoryWatch);
+#endif
+  }
+#endif
+#ifdef HAVE_IO_URING
+  /* init io_uring instance */
+  if (eventBackend == backendUring)
+  {
+    exitIfError(initUring(&ring, URING_ENTRIES), "Error creating io_uring instance");
+    queueUringOperation(0, uringAccept);
+    queueUringOperation(0, uringWakeup);
+#ifdef HAVE_INOTIFY
+    if (directoryWatch.fd != -1)
+      queueUringOperation(0, uringWatch);
+#endif
+  }
+#endif
+  /* publishes the pointers for the status report */
+  __atomic_store_n(&loop->running, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Thread entry point of the additional event loops
+ * \param loop The loop to run
+ * \returns Nothing, once the server is stopped
+ */
+void * runEventLoop(void * loop)
+{
+  initEventLoop(loop);
+  talkToClients();
+  pthread_barrier_wait(&stopBarrier);
+  cleanUpEventLoop();
+  return 0;
+}
+
+/**
+ * Makes a snapshot the one new answers are sent from. The event loops
+ * switch over with their next request.
+ * \param snapshot The new snapshot, its reference goes to \a currentSnapshot.
+ */
+void installSnapshot(struct snapshot * snapshot)
+{
+  pthread_mutex_lock(&snapshotLock);
+  struct snapshot * old = currentSnapshot;
+  currentSnapshot = snapshot;
+  __atomic_add_fetch(&snapshotGeneration, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&snapshotLock);
+  if (old != NULL)
+    releaseSnapshot(old);
+}
+
+/**
+ * Thread entry point of the reloader: rebuilds the snapshot of the
+ * document root on every SIGHUP, while the event loops keep answering
+ * from the old one.
+ * \param unused Nothing.
+ * \returns Nothing, the thread does not terminate
+ */
+void * reloadDocuments(void * unused)
+{
+  (void)unused;
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGHUP);
+  for (;;)
+  {
+    int received;
+    if (sigwait(&signals, &received) != 0)
+      continue;
+    struct snapshot * snapshot = buildSnapshot(documentRoot, preloadedExtras);
+    if (snapshot == NULL)
+    {
+      doLog(errorLog, "Reloading the document root failed, keeping the old one");
+      continue;
+    }
+    doLog(errorLog, "Reloaded the document root: %u files, %lu bytes",
+          snapshot->fileCount, (unsigned long)snapshot->arenaSize);
+    installSnapshot(snapshot);
+  }
+  return 0;
+}
+
+/**
+ * Starts a server listing on a specified port. Additional event loops are
+ * started in their own threads, the first one is set up in the calling thread.
+ * \param port_s The Port or service name to listen on
+ */
+void server(char * port_s)
+{
+  int port = resolvePort(port_s);
+  if (port == -1)
+    exit(1);
+
   /* init logs */
   accessLog = initLog(ACCESSLOG);
   errorLog = initLog(ERRORLOG);
@@ -787,10 +3753,111 @@ void server(char * port_s)
     fputs("Logs are not accessible!\n", stderr);
     exit(1);
   }
+
+  /* open all sockets up front, so that errors show up before any loop runs */
+  struct eventLoop * newLoops = calloc(threadCount, sizeof(struct eventLoop));
+  if (newLoops == NULL)
+  {
+    fputs("Could not allocate event loops", stderr);
+    exit(1);
+  }
+  int i;
+  for (i = 0; i < threadCount; ++i)
+  {
+    newLoops[i].listeningSocket = openListeningSocket(port);
+    /* other loops, workers and the signal handler wake a loop up */
+    newLoops[i].wakeupFd = eventfd(0, EFD_NONBLOCK);
+    exitIfError(newLoops[i].wakeupFd, "Error creating wakeup fd");
+  }
+  pthread_barrier_init(&stopBarrier, NULL, threadCount);
+  /* the signal handler may use them from now on */
+  loops = newLoops;
+  #ifdef DEBUG
+  puts("Server started, talking to clients");
+  #endif
+
+  if (preloadDocuments)
+  {
+    struct snapshot * snapshot = buildSnapshot(documentRoot, preloadedExtras);
+    if (snapshot == NULL)
+    {
+      fputs("Could not preload the document root", stderr);
+      exit(1);
+    }
+  #ifdef DEBUG
+    printf("Preloaded %u files, %lu bytes\n", snapshot->fileCount,
+           (unsigned long)snapshot->arenaSize);
+  #endif
+    installSnapshot(snapshot);
+  }
+
+  /* signals are handled by the main thread only, SIGHUP by the reloader */
+  sigset_t signals, oldSignals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  if (preloadDocuments)
+    sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+  /* a snapshot answers without touching the disk */
+  if (fileThreads > 0 && !preloadDocuments)
+  {
+    int result = startWorkerPool(&fileWorkers, fileThreads, runFileJob);
+    if (result != 0)
+    {
+      errno = result;
+      perror("Error starting file threads");
+      exit(1);
+    }
+  }
+  if (preloadDocuments)
+  {
+    int result = pthread_create(&reloader, NULL, reloadDocuments, NULL);
+    if (result != 0)
+    {
+      errno = result;
+      perror("Error starting reloader thread");
+      exit(1);
+    }
+    sigaddset(&oldSignals, SIGHUP);
+  }
+  for (i = 1; i < threadCount; ++i)
+  {
+    int result = pthread_create(&loops[i].thread, NULL, runEventLoop, loops + i);
+    if (result != 0)
+    {
+      errno = result;
+      perror("Error starting event loop thread");
+      exit(1);
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+  initEventLoop(loops);
+}
+
+/**
+ * Waits for the event loops to stop and frees what they shared. Runs in the
+ * thread of the first loop once it stopped.
+ */
+void stopServer()
+{
+  pthread_barrier_wait(&stopBarrier);
+  cleanUpEventLoop();
+  int i;
+  for (i = 1; i < threadCount; ++i)
+    pthread_join(loops[i].thread, NULL);
+  if (preloadDocuments)
+  {
+    pthread_cancel(reloader);
+    pthread_join(reloader, NULL);
+  }
+  freeLog(accessLog);
+  freeLog(errorLog);
+  fflush(stdout);
 }
 
 /**
- * Callback to handle signals.
+ * Callback to handle signals: asks all event loops to stop, see \a stopServer.
  * \param signal The signal number received.
  */
 void signalHandler(int signal)
@@ -800,10 +3867,50 @@ void signalHandler(int signal)
     #ifdef DEBUG
       puts("Caught Signal SIGTERM or SIGINT, exiting...\n");
     #endif
-    exit(0);
+    if (loops == 0)
+      _exit(0);
+    __atomic_store_n(&stopRequested, 1, __ATOMIC_RELAXED);
+    const uint64_t one = 1;
+    int i;
+    for (i = 0; i < threadCount; ++i)
+      write(loops[i].wakeupFd, &one, sizeof(one));
+  }
+}
+
+/**
+ * Converts a timeout given on the command line.
+ * \param argument The timeout in seconds, 0 to disable it.
+ * \returns The timeout in milliseconds.
+ */
+int parseTimeoutArgument(const char * argument)
+{
+  int seconds = atoi(argument);
+  if (seconds < 0 || seconds > INT_MAX / 1000)
+  {
+    fprintf(stderr, "ERROR: Invalid timeout \"%s\"!\n", argument);
+    exit(1);
   }
+  return seconds * 1000;
 }
 
+/** \brief Values of the options that only have a long name */
+enum longOnlyOption
+{
+  optionHeaderTimeout = 256,
+  optionBodyTimeout,
+  optionWriteTimeout,
+  optionLongPollTimeout,
+  optionKeepAliveTimeout,
+  optionMaxRequests,
+  optionScanner,
+  optionFileCache,
+  optionOpenFiles,
+  optionFileCacheValid,
+  optionPreload,
+  optionNoWatch,
+  optionFileThreads
+};
+
 /**
  * Parse the given command line arguments and act accordingly.
  * \param argc The argument count
@@ -813,29 +3920,97 @@ void parseCmdLineArguments(int argc, char* argv[])
 {
   static struct option long_options[] =
   {
+    {"backend", required_argument, 0, 'b'},
+    {"max-connections", required_argument, 0, 'c'},
     {"help", no_argument, 0, 'h'},
+    {"backlog", required_argument, 0, 'l'},
+    {"max-memory", required_argument, 0, 'm'},
+    {"overload", required_argument, 0, 'o'},
     /*{"listen", no_argument, 0, 'l'},*/
     {"port", required_argument, 0, 'p'},
+    {"threads", required_argument, 0, 't'},
+    {"header-timeout", required_argument, 0, optionHeaderTimeout},
+    {"body-timeout", required_argument, 0, optionBodyTimeout},
+    {"write-timeout", required_argument, 0, optionWriteTimeout},
+    {"longpoll-timeout", required_argument, 0, optionLongPollTimeout},
+    {"keepalive-timeout", required_argument, 0, optionKeepAliveTimeout},
+    {"max-requests", required_argument, 0, optionMaxRequests},
+    {"scanner", required_argument, 0, optionScanner},
+    {"file-cache", required_argument, 0, optionFileCache},
+    {"open-files", required_argument, 0, optionOpenFiles},
+    {"cache-valid", required_argument, 0, optionFileCacheValid},
+    {"preload", no_argument, 0, optionPreload},
+    {"no-watch", no_argument, 0, optionNoWatch},
+    {"file-threads", required_argument, 0, optionFileThreads},
     {0,0,0,0} /* end-of-array-marker */
   };
 
   /*parse options*/
+  const char * scanner = 0;
   int port = 0;
   char port_s[21];
   memset(port_s, 0, sizeof(port_s));
   for (;;)
   {
-    int result = getopt_long(argc, argv, "hp:", (struct option *)&long_options, NULL);
+    int result = getopt_long(argc, argv, "b:c:hl:m:o:p:t:", (struct option *)&long_options, NULL);
 
     if (result == -1)
       break;
     switch(result)
     {
+      case 'b':
+        if (strcmp(optarg, "poll") == 0)
+          eventBackend = backendPoll;
+#ifdef HAVE_EPOLL
+        else if (strcmp(optarg, "epoll") == 0)
+          eventBackend = backendEpoll;
+#endif
+#ifdef HAVE_IO_URING
+        else if (strcmp(optarg, "uring") == 0)
+          eventBackend = backendUring;
+#endif
+        else
+        {
+          fprintf(stderr, "ERROR: Unknown event backend \"%s\"!\n", optarg);
+          exit(1);
+        }
+        break;
       case 'h':
         puts("HTTPD: A web server by Sebastian Dörner");
         puts("start server:\t nc [-p port]");
         puts("options:");
         puts("\t-p port\t\t port to listen on (Default: 80)");
+        puts("\t-l backlog\t length of the queue of pending connections (Default: SOMAXCONN)");
+        puts("\t-t threads\t number of event loops, each in its own thread (Default: 1)");
+        printf("\t-c connections\t maximal number of connections (Default: %d)\n", MAXCON);
+        printf("\t-m MiB\t\t maximal memory for connections and buffers (Default: %d, 0 = unlimited)\n", DEFAULT_MAX_MEMORY_MB);
+        puts("\t-o policy\t what happens to new clients at these limits (Default: reject)");
+        puts("\t\t\t pause: stop accepting, they wait in the backlog");
+        puts("\t\t\t reject: answer 503 with Retry-After and close");
+        puts("\t--header-timeout s  time to send the request headers (Default: 10, 0 = forever)");
+        puts("\t--body-timeout s    idle time while sending a request body (Default: 30)");
+        puts("\t--write-timeout s   idle time while we send an answer (Default: 30)");
+        puts("\t--longpoll-timeout s time a chat receiver waits for messages (Default: 60)");
+        puts("\t--keepalive-timeout s idle time between two requests on a connection (Default: 5)");
+        puts("\t--max-requests n    requests served over one connection (Default: 100, 0 = unlimited)");
+        puts("\t--scanner isa       header scanners: avx2, sse2 or scalar (Default: best supported)");
+        printf("\t--file-cache MiB    memory for caching served files (Default: %d, 0 = off)\n", DEFAULT_FILE_CACHE_MB);
+        printf("\t--open-files n      files kept open with their status (Default: %d, 0 = off)\n", DEFAULT_OPEN_FILES);
+        puts("\t--cache-valid s     time until cached files are checked again if changes are not");
+        puts("\t                    reported (Default: 1, 0 = always)");
+#ifdef HAVE_INOTIFY
+        puts("\t--no-watch          check cached files instead of watching the documents with inotify");
+#endif
+        puts("\t--preload           answer from a copy of the document root in memory, SIGHUP reloads it");
+        printf("\t--file-threads n    threads that open files and read them from disk (Default: %d, 0 = none)\n", DEFAULT_FILE_THREADS);
+        puts("\t-b backend\t event backend (Default: epoll if available)");
+        puts("\t\t\t poll: portable poll() loop");
+#ifdef HAVE_EPOLL
+        puts("\t\t\t epoll: edge-triggered epoll loop");
+#endif
+#ifdef HAVE_IO_URING
+        puts("\t\t\t uring: io_uring engine with batched submissions");
+#endif
         exit(0);
         break;
       case 'p':
@@ -849,6 +4024,108 @@ void parseCmdLineArguments(int argc, char* argv[])
         port_s[20] = '\0';
         port = atoi(optarg);
         break;
+      case 'l':
+        listenBacklog = atoi(optarg);
+        if (listenBacklog < 1)
+        {
+          fputs("ERROR: The backlog must be positive!\n", stderr);
+          exit(1);
+        }
+        break;
+      case 'c':
+        maxConnections = atoi(optarg);
+        if (maxConnections < 1)
+        {
+          fputs("ERROR: Need room for at least one connection!\n", stderr);
+          exit(1);
+        }
+        break;
+      case 'm':
+        if (atoi(optarg) < 0)
+        {
+          fputs("ERROR: The memory limit must not be negative!\n", stderr);
+          exit(1);
+        }
+        maxMemory = (size_t)atoi(optarg) * 1024 * 1024;
+        break;
+      case 'o':
+        if (strcmp(optarg, "pause") == 0)
+          overload = overloadPause;
+        else if (strcmp(optarg, "reject") == 0)
+          overload = overloadReject;
+        else
+        {
+          fprintf(stderr, "ERROR: Unknown overload policy \"%s\"!\n", optarg);
+          exit(1);
+        }
+        break;
+      case 't':
+        threadCount = atoi(optarg);
+        if (threadCount < 1)
+        {
+          fputs("ERROR: Need at least one thread!\n", stderr);
+          exit(1);
+        }
+        break;
+      case optionHeaderTimeout:
+        headerTimeout = parseTimeoutArgument(optarg);
+        break;
+      case optionBodyTimeout:
+        bodyTimeout = parseTimeoutArgument(optarg);
+        break;
+      case optionWriteTimeout:
+        writeTimeout = parseTimeoutArgument(optarg);
+        break;
+      case optionLongPollTimeout:
+        longPollTimeout = parseTimeoutArgument(optarg);
+        break;
+      case optionKeepAliveTimeout:
+        keepAliveTimeout = parseTimeoutArgument(optarg);
+        break;
+      case optionMaxRequests:
+        maxRequests = atoi(optarg);
+        if (maxRequests < 0)
+        {
+          fputs("ERROR: The number of requests per connection must not be negative!\n", stderr);
+          exit(1);
+        }
+        break;
+      case optionScanner:
+        scanner = optarg;
+        break;
+      case optionFileCache:
+        if (atoi(optarg) < 0)
+        {
+          fputs("ERROR: The file cache size must not be negative!\n", stderr);
+          exit(1);
+        }
+        fileCacheSize = (size_t)atoi(optarg) * 1024 * 1024;
+        break;
+      case optionOpenFiles:
+        openFiles = atoi(optarg);
+        if (openFiles < 0)
+        {
+          fputs("ERROR: The number of open files must not be negative!\n", stderr);
+          exit(1);
+        }
+        break;
+      case optionFileCacheValid:
+        fileCacheValid = parseTimeoutArgument(optarg);
+        break;
+      case optionPreload:
+        preloadDocuments = 1;
+        break;
+      case optionNoWatch:
+        watchDocuments = 0;
+        break;
+      case optionFileThreads:
+        fileThreads = atoi(optarg);
+        if (fileThreads < 0)
+        {
+          fputs("ERROR: The number of file threads must not be negative!\n", stderr);
+          exit(1);
+        }
+        break;
       case ':':
       #ifdef DEBUG
         puts("Missing parameter\n");
@@ -871,8 +4148,17 @@ void parseCmdLineArguments(int argc, char* argv[])
     fputs("ERROR: No port given!\n", stderr);
     exit(1);
   }
+  if (!selectScanKernels(scanner))
+  {
+    fprintf(stderr, "ERROR: The processor does not support the \"%s\" scanners!\n", scanner);
+    exit(1);
+  }
+  #ifdef DEBUG
+    printf("Scanning headers with %s instructions\n", scanKernels->name);
+  #endif
   server(port_s);
   talkToClients();
+  stopServer();
 }
 
 /**
@@ -885,9 +4171,8 @@ int main (int argc, char * argv[])
   /*register signal handlers*/
   signal( SIGTERM, signalHandler);
   signal( SIGINT, signalHandler);
-  /*register cleanUp function*/
-  int result = atexit(cleanUpOnExit);
-  exitIfError(result, "Error registering exit function:");
+  /* errors on client sockets are handled per connection */
+  signal( SIGPIPE, SIG_IGN);
   parseCmdLineArguments(argc, argv);
   return 0;
 }
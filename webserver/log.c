@@ -1,7 +1,10 @@
 /**
  * \file log.c
  * \brief Implementation of a simple message logger.
+ *
+ * Logging is thread safe, concurrent messages are not interleaved.
  */
+#define _GNU_SOURCE
 #include "log.h"
 
 #include <errno.h>
@@ -17,13 +20,13 @@
 void printTimeStamp(struct log * log)
 {
   time_t rawtime;
-  struct tm * timeinfo;
+  struct tm timeinfo;
   char buffer [80];
 
   time ( &rawtime );
-  timeinfo = localtime ( &rawtime );
+  localtime_r ( &rawtime, &timeinfo );
 
-  strftime (buffer,80,"[%d/%b/%Y %H:%M:%S] ",timeinfo);
+  strftime (buffer,80,"[%d/%b/%Y %H:%M:%S] ",&timeinfo);
   fputs (buffer, log->logFile);
 }
 
@@ -69,6 +72,8 @@ int freeLog(struct log * log)
  */
 void doLog(struct log * log, const char * formatString, ...)
 {
+  /* hold the stream lock for the whole line */
+  flockfile(log->logFile);
   printTimeStamp(log);
   /* print message */
   va_list argptr;
@@ -78,4 +83,5 @@ void doLog(struct log * log, const char * formatString, ...)
   /* append newline */
   fputc('\n', log->logFile);
   fflush(log->logFile);
+  funlockfile(log->logFile);
 }
@@ -0,0 +1,34 @@
+/**
+ * \file mime.c
+ * \brief Looks up content types in the table generated from mime.types.
+ */
+#define _GNU_SOURCE
+
+#include "mime.h"
+#include "mimehash.h"
+#include "mimetable.h"
+
+#include <string.h>
+#include <strings.h> /* strncasecmp */
+
+/**
+ * Determines the content type of a file from its extension.
+ * \param path Path or name of the file.
+ * \returns The content type, \a MIME_DEFAULT_TYPE if the extension is unknown.
+ */
+const char * mimeType(const char * path)
+{
+  const char * dot = strrchr(path, '.');
+  if (dot == NULL || strchr(dot, '/') != NULL)
+    return MIME_DEFAULT_TYPE;
+  const char * extension = dot + 1;
+  unsigned int length = strlen(extension);
+  if (length > MIME_MAX_EXTENSION)
+    return MIME_DEFAULT_TYPE;
+  const struct mimeEntry * entry =
+    &mimeTable[mimeHash(extension, length, MIME_HASH_SEED) >> (32 - MIME_TABLE_BITS)];
+  if (entry->extension == 0 || strlen(entry->extension) != length
+      || strncasecmp(entry->extension, extension, length) != 0)
+    return MIME_DEFAULT_TYPE;
+  return entry->type;
+}
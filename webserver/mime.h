@@ -0,0 +1,13 @@
+/**
+ * \file mime.h
+ * \brief Content types of the served files.
+ */
+#ifndef __MIME__
+#define __MIME__
+
+/** \brief Content type of files with an unknown extension */
+#define MIME_DEFAULT_TYPE "application/octet-stream"
+
+const char * mimeType(const char * path);
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * \file mimegen.c
+ * \brief Build tool that turns mime.types into a perfect hash table.
+ *
+ * Searches a seed for \a mimeHash under which all extensions land in
+ * different slots of a table with a power of two size, and writes the
+ * table as a C header. The slot is taken from the top bits of the hash,
+ * the low bits of FNV mix poorly. Looking up a type then takes one hash
+ * and one string comparison.
+ *
+ * usage: mimegen mime.types mimetable.h
+ */
+#define _GNU_SOURCE
+
+#include "mimehash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** \brief Maximal number of entries in mime.types */
+#define MAX_ENTRIES 256
+/** \brief Seeds tried per table size before the table is made larger */
+#define SEEDS_PER_SIZE 1000000
+
+/** \brief The pairs read from mime.types */
+struct mimeEntry entries[MAX_ENTRIES];
+/** \brief Number of valid \a entries */
+int entryCount = 0;
+
+/**
+ * Reads the extension/type pairs, skipping empty lines and comments.
+ * \param filename The mime.types file.
+ */
+void readEntries(const char * filename)
+{
+  FILE * file = fopen(filename, "r");
+  if (file == NULL)
+  {
+    perror(filename);
+    exit(1);
+  }
+  char line[256];
+  int lineNumber = 0;
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    ++lineNumber;
+    char * extension = strtok(line, " \t\r\n");
+    if (extension == NULL || extension[0] == '#')
+      continue;
+    char * type = strtok(NULL, " \t\r\n");
+    if (type == NULL || strlen(extension) > MIME_MAX_EXTENSION || entryCount == MAX_ENTRIES)
+    {
+      fprintf(stderr, "%s:%d: invalid entry\n", filename, lineNumber);
+      exit(1);
+    }
+    entries[entryCount].extension = strdup(extension);
+    entries[entryCount].type = strdup(type);
+    ++entryCount;
+  }
+  fclose(file);
+}
+
+/**
+ * Checks whether a seed maps all extensions to different slots.
+ * \param seed The seed to try.
+ * \param bits The table has 2^bits slots.
+ * \param slots Receives the table on success.
+ * \returns 1 if there are no collisions, 0 otherwise.
+ */
+int trySeed(unsigned int seed, unsigned int bits, const struct mimeEntry ** slots)
+{
+  memset(slots, 0, (1u << bits) * sizeof(slots[0]));
+  int i;
+  for (i = 0; i < entryCount; ++i)
+  {
+    unsigned int slot = mimeHash(entries[i].extension, strlen(entries[i].extension), seed) >> (32 - bits);
+    if (slots[slot] != NULL)
+      return 0;
+    slots[slot] = &entries[i];
+  }
+  return 1;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc != 3)
+  {
+    fputs("usage: mimegen mime.types mimetable.h\n", stderr);
+    return 1;
+  }
+  readEntries(argv[1]);
+
+  unsigned int bits = 1;
+  while ((1 << bits) < entryCount)
+    ++bits;
+  const struct mimeEntry ** slots = NULL;
+  unsigned int seed = 0;
+  for (;;)
+  {
+    slots = realloc(slots, (1u << bits) * sizeof(slots[0]));
+    for (seed = 0; seed < SEEDS_PER_SIZE; ++seed)
+      if (trySeed(seed, bits, slots))
+        break;
+    if (seed < SEEDS_PER_SIZE)
+      break;
+    ++bits;
+  }
+  unsigned int size = 1u << bits;
+
+  FILE * out = fopen(argv[2], "w");
+  if (out == NULL)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  fprintf(out, "/* generated by mimegen from %s, do not edit */\n", argv[1]);
+  fprintf(out, "#define MIME_HASH_SEED %uu\n", seed);
+  fprintf(out, "#define MIME_TABLE_BITS %u\n", bits);
+  fprintf(out, "#define MIME_TABLE_SIZE %u\n", size);
+  fputs("const struct mimeEntry mimeTable[MIME_TABLE_SIZE] =\n{\n", out);
+  unsigned int i;
+  for (i = 0; i < size; ++i)
+  {
+    if (slots[i] == NULL)
+      fputs("  {0, 0},\n", out);
+    else
+      fprintf(out, "  {\"%s\", \"%s\"},\n", slots[i]->extension, slots[i]->type);
+  }
+  fputs("};\n", out);
+  if (fclose(out) != 0)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  free(slots);
+  return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * \file mimehash.h
+ * \brief The hash function of the MIME table, shared by mimegen and mime.c.
+ */
+#ifndef __MIMEHASH__
+#define __MIMEHASH__
+
+/** \brief Longest extension in the MIME table */
+#define MIME_MAX_EXTENSION 15
+
+/** \brief An entry of the generated MIME table */
+struct mimeEntry
+{
+  /** \brief File extension in lower case, 0 for an empty slot */
+  const char * extension;
+  /** \brief Content type sent for files with that extension */
+  const char * type;
+};
+
+/**
+ * Hashes a file extension, ignoring case (FNV-1a). Static, every includer
+ * gets its own copy.
+ * \param extension The extension without the dot.
+ * \param length Length of \a extension.
+ * \param seed Start value, chosen by mimegen so that there are no collisions.
+ * \returns The hash value.
+ */
+static unsigned int mimeHash(const char * extension, unsigned int length, unsigned int seed)
+{
+  unsigned int hash = 2166136261u ^ seed;
+  unsigned int i;
+  for (i = 0; i < length; ++i)
+  {
+    unsigned char c = extension[i];
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    hash = (hash ^ c) * 16777619u;
+  }
+  return hash;
+}
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * \file pool.c
+ * \brief Implementation of memory pools for connection objects and buffers.
+ */
+#include "pool.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Initializes an empty object pool.
+ * \param pool The pool to initialize.
+ * \param objectSize Size of the objects handed out.
+ * \param objectsPerSlab Number of objects to allocate at once.
+ */
+void initObjectPool(struct objectPool * pool, size_t objectSize, unsigned objectsPerSlab)
+{
+  memset(pool, 0, sizeof(struct objectPool));
+  /* free objects store the list pointer in place */
+  if (objectSize < sizeof(void *))
+    objectSize = sizeof(void *);
+  /* keep the objects of a slab aligned */
+  pool->objectSize = (objectSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  pool->objectsPerSlab = objectsPerSlab;
+}
+
+/**
+ * Takes a zeroed object from the pool, allocating a new slab if necessary.
+ * \param pool The pool to allocate from.
+ * \returns The object or NULL if no memory is left.
+ */
+void * allocObject(struct objectPool * pool)
+{
+  void * object;
+  if (pool->freeList != NULL)
+    STATS_ADD(pool->stats.hits, 1);
+  else
+  {
+    /* the first object sized slot of a slab links it into the slab list */
+    size_t header = pool->objectSize;
+    char * slab = malloc(header + pool->objectSize * pool->objectsPerSlab);
+    if (slab == NULL)
+      return NULL;
+    STATS_ADD(pool->stats.misses, 1);
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+    STATS_ADD(pool->stats.residentBytes, pool->objectSize * pool->objectsPerSlab);
+    unsigned i;
+    for (i = 0; i < pool->objectsPerSlab; ++i)
+    {
+      void * newObject = slab + header + i * pool->objectSize;
+      *(void **)newObject = pool->freeList;
+      pool->freeList = newObject;
+    }
+  }
+  object = pool->freeList;
+  pool->freeList = *(void **)object;
+  STATS_ADD(pool->stats.usedBytes, pool->objectSize);
+  memset(object, 0, pool->objectSize);
+  return object;
+}
+
+/**
+ * Returns an object to the pool.
+ * \param pool The pool the object was taken from.
+ * \param object The object, NULL is ignored.
+ */
+void freeObject(struct objectPool * pool, void * object)
+{
+  if (object == NULL)
+    return;
+  *(void **)object = pool->freeList;
+  pool->freeList = object;
+  STATS_SUB(pool->stats.usedBytes, pool->objectSize);
+}
+
+/**
+ * Frees all slabs of a pool, including objects still in use.
+ * \param pool The pool to destroy.
+ */
+void destroyObjectPool(struct objectPool * pool)
+{
+  while (pool->slabs != NULL)
+  {
+    void * next = *(void **)pool->slabs;
+    free(pool->slabs);
+    pool->slabs = next;
+  }
+  memset(pool, 0, sizeof(struct objectPool));
+}
+
+/**
+ * Initializes an empty buffer pool.
+ * \param pool The pool to initialize.
+ * \param maxCachedBytes Free buffers exceeding this limit go back to the system.
+ */
+void initBufferPool(struct bufferPool * pool, size_t maxCachedBytes)
+{
+  memset(pool, 0, sizeof(struct bufferPool));
+  pool->maxCachedBytes = maxCachedBytes;
+}
+
+/**
+ * Determines the size class of a buffer.
+ * \param size The requested size.
+ * \returns The index of the smallest class that fits, POOL_CLASS_COUNT if none does.
+ */
+int bufferClass(size_t size)
+{
+  int class = 0;
+  while (class < POOL_CLASS_COUNT && ((size_t)1 << (POOL_MIN_CLASS_SHIFT + class)) < size)
+    ++class;
+  return class;
+}
+
+/**
+ * Rounds a buffer size up to its size class.
+ * \param size The requested size.
+ * \returns The size actually provided by \a allocBuffer, \a size itself if it exceeds all classes.
+ */
+size_t bufferClassSize(size_t size)
+{
+  int class = bufferClass(size);
+  if (class == POOL_CLASS_COUNT)
+    return size;
+  return (size_t)1 << (POOL_MIN_CLASS_SHIFT + class);
+}
+
+/**
+ * Takes a buffer from the pool. Its content is undefined.
+ * \param pool The pool to allocate from.
+ * \param size The minimal size, the buffer provides \a bufferClassSize(size) bytes.
+ * \returns The buffer or NULL if no memory is left.
+ */
+char * allocBuffer(struct bufferPool * pool, size_t size)
+{
+  int class = bufferClass(size);
+  size_t classSize = bufferClassSize(size);
+  char * buffer;
+  if (class < POOL_CLASS_COUNT && pool->freeLists[class] != NULL)
+  {
+    buffer = pool->freeLists[class];
+    pool->freeLists[class] = *(void **)buffer;
+    pool->cachedBytes -= classSize;
+    STATS_ADD(pool->stats.hits, 1);
+  }
+  else
+  {
+    buffer = malloc(classSize);
+    if (buffer == NULL)
+      return NULL;
+    STATS_ADD(pool->stats.residentBytes, classSize);
+    STATS_ADD(pool->stats.misses, 1);
+  }
+  STATS_ADD(pool->stats.usedBytes, classSize);
+  return buffer;
+}
+
+/**
+ * Moves the content of a buffer to a larger one.
+ * \param pool The pool the buffer was taken from.
+ * \param buffer The buffer to grow.
+ * \param oldSize The size the buffer was allocated with.
+ * \param newSize The minimal new size.
+ * \param used Number of bytes to keep.
+ * \returns The new buffer or NULL if no memory is left (\a buffer is still valid then).
+ */
+char * growBuffer(struct bufferPool * pool, char * buffer, size_t oldSize, size_t newSize, size_t used)
+{
+  char * newBuffer = allocBuffer(pool, newSize);
+  if (newBuffer == NULL)
+    return NULL;
+  memcpy(newBuffer, buffer, used);
+  releaseBuffer(pool, buffer, oldSize);
+  return newBuffer;
+}
+
+/**
+ * Returns a buffer to the pool.
+ * \param pool The pool the buffer was taken from.
+ * \param buffer The buffer, NULL is ignored.
+ * \param size The size the buffer was allocated with.
+ */
+void releaseBuffer(struct bufferPool * pool, char * buffer, size_t size)
+{
+  if (buffer == NULL)
+    return;
+  int class = bufferClass(size);
+  size_t classSize = bufferClassSize(size);
+  STATS_SUB(pool->stats.usedBytes, classSize);
+  if (class < POOL_CLASS_COUNT && pool->cachedBytes + classSize <= pool->maxCachedBytes)
+  {
+    *(void **)buffer = pool->freeLists[class];
+    pool->freeLists[class] = buffer;
+    pool->cachedBytes += classSize;
+  }
+  else
+  {
+    free(buffer);
+    STATS_SUB(pool->stats.residentBytes, classSize);
+  }
+}
+
+/**
+ * Frees all cached buffers of a pool. Buffers still in use are not affected.
+ * \param pool The pool to destroy.
+ */
+void destroyBufferPool(struct bufferPool * pool)
+{
+  int class;
+  for (class = 0; class < POOL_CLASS_COUNT; ++class)
+    while (pool->freeLists[class] != NULL)
+    {
+      void * next = *(void **)pool->freeLists[class];
+      free(pool->freeLists[class]);
+      pool->freeLists[class] = next;
+    }
+  memset(pool, 0, sizeof(struct bufferPool));
+}
@@ -0,0 +1,81 @@
+/**
+ * \file pool.h
+ * \brief Memory pools for connection objects and buffers.
+ *
+ * Objects of one size are carved out of slabs and recycled through a free
+ * list. Buffers come in power-of-two size classes, each with its own free
+ * list. Pools are not thread safe, every event loop owns its own.
+ */
+
+#ifndef __POOL__
+#define __POOL__
+
+#include <stddef.h>
+
+/** \brief Size of the smallest buffer class (1 KiB) as a power of two */
+#define POOL_MIN_CLASS_SHIFT 10
+/** \brief Number of buffer size classes (1 KiB up to 1 MiB) */
+#define POOL_CLASS_COUNT 11
+
+/** \brief Usage counters of a pool */
+struct poolStats
+{
+  /** \brief Allocations served from a free list */
+  unsigned long hits;
+  /** \brief Allocations that had to go to the system allocator */
+  unsigned long misses;
+  /** \brief Bytes held by the pool, in use or cached */
+  size_t residentBytes;
+  /** \brief Bytes currently handed out */
+  size_t usedBytes;
+};
+
+/** \brief A slab allocator for objects of a single size */
+struct objectPool
+{
+  /** \brief Size of a single object */
+  size_t objectSize;
+  /** \brief Number of objects allocated at once */
+  unsigned objectsPerSlab;
+  /** \brief Singly linked list of free objects */
+  void * freeList;
+  /** \brief Singly linked list of all slabs, for freeing them */
+  void * slabs;
+  /** \brief Usage counters */
+  struct poolStats stats;
+};
+
+/** \brief Buffers of power-of-two size classes */
+struct bufferPool
+{
+  /** \brief Free list of every size class */
+  void * freeLists[POOL_CLASS_COUNT];
+  /** \brief Upper limit of free bytes kept over all classes */
+  size_t maxCachedBytes;
+  /** \brief Free bytes currently kept over all classes */
+  size_t cachedBytes;
+  /** \brief Usage counters */
+  struct poolStats stats;
+};
+
+void initObjectPool(struct objectPool * pool, size_t objectSize, unsigned objectsPerSlab);
+
+void * allocObject(struct objectPool * pool);
+
+void freeObject(struct objectPool * pool, void * object);
+
+void destroyObjectPool(struct objectPool * pool);
+
+void initBufferPool(struct bufferPool * pool, size_t maxCachedBytes);
+
+size_t bufferClassSize(size_t size);
+
+char * allocBuffer(struct bufferPool * pool, size_t size);
+
+char * growBuffer(struct bufferPool * pool, char * buffer, size_t oldSize, size_t newSize, size_t used);
+
+void releaseBuffer(struct bufferPool * pool, char * buffer, size_t size);
+
+void destroyBufferPool(struct bufferPool * pool);
+
+#endif
@@ -0,0 +1,212 @@
+/**
+ * \file scan.c
+ * \brief Implementation of the scalar, SSE2 and AVX2 delimiter scanners.
+ *
+ * The vector kernels build a mask of the bytes that end the token, the
+ * first set bit of the mask is the result. Bytes left over at the end of
+ * the range are handled by the scalar kernels.
+ */
+#define _GNU_SOURCE
+
+#include "scan.h"
+
+#include <string.h>
+
+#if defined(HAVE_CPUID) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/**
+ * Checks whether a character may be part of a method or header name
+ * (a "tchar" of RFC 7230).
+ */
+int isTokenChar(unsigned char c)
+{
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+    return 1;
+  return c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != 0;
+}
+
+/**
+ * Finds the end of a token byte by byte.
+ */
+unsigned int scanTokenScalar(const char * data, unsigned int i, unsigned int end)
+{
+  while (i < end && isTokenChar(data[i]))
+    ++i;
+  return i;
+}
+
+/**
+ * Finds the end of a target or version byte by byte.
+ */
+unsigned int scanTextScalar(const char * data, unsigned int i, unsigned int end)
+{
+  for (; i < end; ++i)
+  {
+    unsigned char c = data[i];
+    if (c <= ' ' || c == 127)
+      break;
+  }
+  return i;
+}
+
+/**
+ * Finds the end of a header value byte by byte.
+ */
+unsigned int scanValueScalar(const char * data, unsigned int i, unsigned int end)
+{
+  for (; i < end; ++i)
+  {
+    unsigned char c = data[i];
+    if ((c < ' ' && c != '\t') || c == 127)
+      break;
+  }
+  return i;
+}
+
+/** \brief Scanners working on single bytes */
+const struct scanKernels scalarKernels =
+  {"scalar", scanTokenScalar, scanTextScalar, scanValueScalar};
+
+#ifdef SCAN_X86
+
+/* Signed comparisons treat bytes from 0x80 on as negative, so "below '!'"
+ * covers them as well. Everything else that is not a tchar lies in three
+ * ranges and five single characters. */
+#define NON_TOKEN_MASK(p, s, v) \
+  p##_or_##s( \
+    p##_or_##s( \
+      p##_or_##s( \
+        p##_cmpgt_epi8(p##_set1_epi8('!'), v), \
+        p##_cmpeq_epi8(v, p##_set1_epi8(127))), \
+      p##_or_##s( \
+        p##_and_##s(p##_cmpgt_epi8(v, p##_set1_epi8('(' - 1)), \
+                                 p##_cmpgt_epi8(p##_set1_epi8(')' + 1), v)), \
+        p##_and_##s(p##_cmpgt_epi8(v, p##_set1_epi8(':' - 1)), \
+                                 p##_cmpgt_epi8(p##_set1_epi8('@' + 1), v)))), \
+    p##_or_##s( \
+      p##_or_##s( \
+        p##_and_##s(p##_cmpgt_epi8(v, p##_set1_epi8('[' - 1)), \
+                                 p##_cmpgt_epi8(p##_set1_epi8(']' + 1), v)), \
+        p##_or_##s(p##_cmpeq_epi8(v, p##_set1_epi8('"')), \
+                                p##_cmpeq_epi8(v, p##_set1_epi8(',')))), \
+      p##_or_##s( \
+        p##_cmpeq_epi8(v, p##_set1_epi8('/')), \
+        p##_or_##s(p##_cmpeq_epi8(v, p##_set1_epi8('{')), \
+                                p##_cmpeq_epi8(v, p##_set1_epi8('}'))))))
+
+/* c <= ' ' (unsigned) holds exactly if min(c, ' ') == c */
+#define TEXT_END_MASK(p, s, v) \
+  p##_or_##s( \
+    p##_cmpeq_epi8(p##_min_epu8(v, p##_set1_epi8(' ')), v), \
+    p##_cmpeq_epi8(v, p##_set1_epi8(127)))
+
+#define VALUE_END_MASK(p, s, v) \
+  p##_or_##s( \
+    p##_andnot_##s( \
+      p##_cmpeq_epi8(v, p##_set1_epi8('\t')), \
+      p##_cmpeq_epi8(p##_min_epu8(v, p##_set1_epi8(' ' - 1)), v)), \
+    p##_cmpeq_epi8(v, p##_set1_epi8(127)))
+
+/* Defines a kernel that checks 16 (SSE2) or 32 (AVX2) bytes per step. */
+#define SCAN_KERNEL(function, isa, width, vector, p, s, load, movemask, endMask, tail) \
+  __attribute__((target(isa))) \
+  unsigned int function(const char * data, unsigned int i, unsigned int end) \
+  { \
+    for (; i + width <= end; i += width) \
+    { \
+      vector v = load((const vector *)(data + i)); \
+      unsigned int mask = movemask(endMask(p, s, v)); \
+      if (mask != 0) \
+        return i + __builtin_ctz(mask); \
+    } \
+    return tail(data, i, end); \
+  }
+
+SCAN_KERNEL(scanTokenSse2, "sse2", 16, __m128i, _mm, si128, _mm_loadu_si128, _mm_movemask_epi8,
+            NON_TOKEN_MASK, scanTokenScalar)
+SCAN_KERNEL(scanTextSse2, "sse2", 16, __m128i, _mm, si128, _mm_loadu_si128, _mm_movemask_epi8,
+            TEXT_END_MASK, scanTextScalar)
+SCAN_KERNEL(scanValueSse2, "sse2", 16, __m128i, _mm, si128, _mm_loadu_si128, _mm_movemask_epi8,
+            VALUE_END_MASK, scanValueScalar)
+
+SCAN_KERNEL(scanTokenAvx2, "avx2", 32, __m256i, _mm256, si256, _mm256_loadu_si256, _mm256_movemask_epi8,
+            NON_TOKEN_MASK, scanTokenScalar)
+SCAN_KERNEL(scanTextAvx2, "avx2", 32, __m256i, _mm256, si256, _mm256_loadu_si256, _mm256_movemask_epi8,
+            TEXT_END_MASK, scanTextScalar)
+SCAN_KERNEL(scanValueAvx2, "avx2", 32, __m256i, _mm256, si256, _mm256_loadu_si256, _mm256_movemask_epi8,
+            VALUE_END_MASK, scanValueScalar)
+
+/** \brief Scanners checking 16 bytes at a time */
+const struct scanKernels sse2Kernels =
+  {"sse2", scanTokenSse2, scanTextSse2, scanValueSse2};
+/** \brief Scanners checking 32 bytes at a time */
+const struct scanKernels avx2Kernels =
+  {"avx2", scanTokenAvx2, scanTextAvx2, scanValueAvx2};
+
+/**
+ * Asks the processor whether it supports SSE2.
+ */
+int cpuHasSse2()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (edx & bit_SSE2) != 0;
+}
+
+/**
+ * Asks the processor whether it supports AVX2 and the operating system
+ * saves the 256 bit registers.
+ */
+int cpuHasAvx2()
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    return 0;
+  unsigned int xcr0, xcr0High;
+  __asm__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0High) : "c" (0));
+  if ((xcr0 & 6) != 6)
+    return 0;
+  if (__get_cpuid_max(0, 0) < 7)
+    return 0;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & bit_AVX2) != 0;
+}
+
+#endif
+
+/** \brief The scanners in use */
+const struct scanKernels * scanKernels = &scalarKernels;
+
+/**
+ * Chooses the scanners. Not thread safe, call it before starting threads.
+ * \param name "avx2", "sse2", "scalar" or 0 for the best the processor supports.
+ * \returns 1 on success, 0 if the processor lacks the requested instructions.
+ */
+int selectScanKernels(const char * name)
+{
+#ifdef SCAN_X86
+  if ((name == 0 || strcmp(name, "avx2") == 0) && cpuHasAvx2())
+  {
+    scanKernels = &avx2Kernels;
+    return 1;
+  }
+  if ((name == 0 || strcmp(name, "sse2") == 0) && cpuHasSse2())
+  {
+    scanKernels = &sse2Kernels;
+    return 1;
+  }
+#endif
+  if (name == 0 || strcmp(name, "scalar") == 0)
+  {
+    scanKernels = &scalarKernels;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,35 @@
+/**
+ * \file scan.h
+ * \brief Vectorized search for the delimiters of a request head.
+ *
+ * Each scanner returns the offset of the first byte in [start, end) that
+ * ends the token it scans for, or \a end if there is none. The SSE2 and
+ * AVX2 kernels check 16 or 32 bytes at a time and are chosen at runtime
+ * with cpuid, the scalar ones are used everywhere else.
+ */
+
+#ifndef __SCAN__
+#define __SCAN__
+
+/** \brief Signature of a scanner */
+typedef unsigned int (*scanFunction)(const char * data, unsigned int start, unsigned int end);
+
+/** \brief A set of scanners using the same instructions */
+struct scanKernels
+{
+  /** \brief Name of the instruction set, e.g. "avx2" */
+  const char * name;
+  /** \brief Stops at the first byte that is not a token character (method, header name) */
+  scanFunction token;
+  /** \brief Stops at the first control character or space (target, version) */
+  scanFunction text;
+  /** \brief Stops at the first control character other than tab (header value) */
+  scanFunction value;
+};
+
+/** \brief The scanners in use, scalar until \a selectScanKernels is called */
+extern const struct scanKernels * scanKernels;
+
+int selectScanKernels(const char * name);
+
+#endif
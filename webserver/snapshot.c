@@ -0,0 +1,264 @@
+/**
+ * \file snapshot.c
+ * \brief Implementation of the document root snapshots.
+ *
+ * The tree is walked twice: first the files are listed with their sizes,
+ * then they are read into an arena of the total size, which is made
+ * read-only afterwards. A file that grew in between is left out.
+ */
+#define _GNU_SOURCE
+
+#include "snapshot.h"
+#include "mime.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h> /* PATH_MAX */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** \brief A file found while walking the tree */
+struct listedFile
+{
+  /** \brief Path of the file, NULL once a snapshot entry owns it */
+  char * path;
+  /** \brief Size of the file when it was found */
+  size_t size;
+};
+
+/** \brief The files found so far */
+struct fileList
+{
+  /** \brief The files */
+  struct listedFile * files;
+  /** \brief Number of valid \a files */
+  unsigned int count;
+  /** \brief Physical size of \a files */
+  unsigned int size;
+};
+
+/**
+ * Appends a file to the list.
+ * \returns 1 on success, 0 if no memory is left.
+ */
+int addToList(struct fileList * list, const char * path, size_t size)
+{
+  if (list->count == list->size)
+  {
+    unsigned int newSize = list->size == 0 ? 64 : 2 * list->size;
+    struct listedFile * files = realloc(list->files, newSize * sizeof(struct listedFile));
+    if (files == NULL)
+      return 0;
+    list->files = files;
+    list->size = newSize;
+  }
+  list->files[list->count].path = strdup(path);
+  if (list->files[list->count].path == NULL)
+    return 0;
+  list->files[list->count].size = size;
+  ++list->count;
+  return 1;
+}
+
+/**
+ * Lists the regular files below a directory. Symbolic links are followed,
+ * as open() does when the files are requested.
+ * \param list The list to append to.
+ * \param directory The directory, without trailing slash.
+ * \param depth Number of directories above \a directory that are listed.
+ * \returns 1 on success, 0 if no memory is left.
+ */
+int listDirectory(struct fileList * list, const char * directory, int depth)
+{
+  DIR * dir = opendir(directory);
+  if (dir == NULL)
+    return 1; /* what cannot be read cannot be served either */
+  struct dirent * entry;
+  int success = 1;
+  while (success && (entry = readdir(dir)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name) >= (int)sizeof(path))
+      continue;
+    struct stat fileStat;
+    if (stat(path, &fileStat) == -1)
+      continue;
+    if (S_ISDIR(fileStat.st_mode) && depth < SNAPSHOT_MAX_DEPTH)
+      success = listDirectory(list, path, depth + 1);
+    else if (S_ISREG(fileStat.st_mode))
+      success = addToList(list, path, fileStat.st_size);
+  }
+  closedir(dir);
+  return success;
+}
+
+/**
+ * Reads a listed file into the arena and fills in its entry.
+ * \param file The entry to fill in, it takes over the path on success.
+ * \param listed The file to load.
+ * \param data Where the content goes.
+ * \param space Space left in the arena.
+ * \returns The size of the file, -1 if it could not be read completely.
+ */
+long loadSnapshotFile(struct cachedFile * file, struct listedFile * listed, char * data,
+                      size_t space)
+{
+  int fd = open(listed->path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+  struct stat fileStat;
+  long size = -1;
+  if (fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && (size_t)fileStat.st_size <= space)
+  {
+    size_t done = 0;
+    ssize_t len = 1;
+    while (done < (size_t)fileStat.st_size && len > 0)
+    {
+      len = pread(fd, data + done, fileStat.st_size - done, done);
+      if (len > 0)
+        done += len;
+    }
+    if (done == (size_t)fileStat.st_size)
+      size = done;
+  }
+  close(fd);
+  if (size == -1)
+    return -1;
+  memset(file, 0, sizeof(struct cachedFile));
+  file->path = listed->path;
+  listed->path = NULL;
+  file->hash = hashPath(file->path);
+  file->data = data;
+  file->fd = -1;
+  describeFile(&fileStat, &file->info);
+  file->contentType = mimeType(file->path);
+  file->cached = 1;
+  return size;
+}
+
+/**
+ * Frees a snapshot that is not referenced any more.
+ */
+void freeSnapshot(struct snapshot * snapshot)
+{
+  unsigned int i;
+  for (i = 0; i < snapshot->fileCount; ++i)
+    free(snapshot->files[i].path);
+  if (snapshot->arena != NULL)
+    munmap(snapshot->arena, snapshot->arenaSize);
+  free(snapshot->files);
+  free(snapshot->buckets);
+  free(snapshot);
+}
+
+/**
+ * Loads all regular files below a directory into a new snapshot.
+ * \param root The directory, its files are found by the path "root/...".
+ * \param extraFiles Further files to load by their path, terminated by 0.
+ * \returns The snapshot, holding one reference for the caller, or NULL if
+ * no memory is left.
+ */
+struct snapshot * buildSnapshot(const char * root, const char * const * extraFiles)
+{
+  struct fileList list;
+  memset(&list, 0, sizeof(list));
+  int success = listDirectory(&list, root, 0);
+  for (; success && *extraFiles != 0; ++extraFiles)
+  {
+    struct stat fileStat;
+    if (stat(*extraFiles, &fileStat) == 0 && S_ISREG(fileStat.st_mode))
+      success = addToList(&list, *extraFiles, fileStat.st_size);
+  }
+
+  struct snapshot * snapshot = success ? calloc(1, sizeof(struct snapshot)) : NULL;
+  unsigned int i;
+  if (snapshot != NULL)
+  {
+    for (i = 0; i < list.count; ++i)
+      snapshot->arenaSize += list.files[i].size;
+    unsigned int bucketCount = 16;
+    while (bucketCount < 2 * list.count)
+      bucketCount *= 2;
+    snapshot->bucketMask = bucketCount - 1;
+    snapshot->buckets = calloc(bucketCount, sizeof(struct cachedFile *));
+    snapshot->files = calloc(list.count + 1, sizeof(struct cachedFile));
+    if (snapshot->arenaSize > 0)
+    {
+      snapshot->arena = mmap(0, snapshot->arenaSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (snapshot->arena == MAP_FAILED)
+        snapshot->arena = NULL;
+    }
+    if (snapshot->buckets == NULL || snapshot->files == NULL
+        || (snapshot->arena == NULL && snapshot->arenaSize > 0))
+    {
+      freeSnapshot(snapshot);
+      snapshot = NULL;
+    }
+  }
+  if (snapshot != NULL)
+  {
+    size_t used = 0;
+    for (i = 0; i < list.count; ++i)
+    {
+      struct cachedFile * file = &snapshot->files[snapshot->fileCount];
+      long size = loadSnapshotFile(file, &list.files[i], snapshot->arena + used,
+                                   snapshot->arenaSize - used);
+      if (size < 0)
+        continue;
+      used += size;
+      file->snapshot = snapshot;
+      file->hashNext = snapshot->buckets[file->hash & snapshot->bucketMask];
+      snapshot->buckets[file->hash & snapshot->bucketMask] = file;
+      ++snapshot->fileCount;
+    }
+    if (snapshot->arena != NULL)
+      mprotect(snapshot->arena, snapshot->arenaSize, PROT_READ);
+    snapshot->references = 1;
+  }
+  for (i = 0; i < list.count; ++i)
+    free(list.files[i].path);
+  free(list.files);
+  return snapshot;
+}
+
+/**
+ * Looks a file up in a snapshot. The caller needs to hold a reference to
+ * the snapshot as long as it uses the entry.
+ * \param snapshot The snapshot.
+ * \param path The path of the file.
+ * \returns The entry or NULL if the snapshot has no such file.
+ */
+struct cachedFile * findSnapshotFile(struct snapshot * snapshot, const char * path)
+{
+  unsigned int hash = hashPath(path);
+  struct cachedFile * file = snapshot->buckets[hash & snapshot->bucketMask];
+  while (file != NULL && (file->hash != hash || strcmp(file->path, path) != 0))
+    file = file->hashNext;
+  return file;
+}
+
+/**
+ * Takes another reference to a snapshot, from any thread. The caller
+ * already needs to hold one.
+ * \param snapshot The snapshot.
+ */
+void retainSnapshot(struct snapshot * snapshot)
+{
+  __atomic_add_fetch(&snapshot->references, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Drops a reference to a snapshot, from any thread. The last one frees it.
+ * \param snapshot The snapshot.
+ */
+void releaseSnapshot(struct snapshot * snapshot)
+{
+  if (__atomic_sub_fetch(&snapshot->references, 1, __ATOMIC_ACQ_REL) == 0)
+    freeSnapshot(snapshot);
+}
@@ -0,0 +1,49 @@
+/**
+ * \file snapshot.h
+ * \brief An immutable copy of the document root in memory.
+ *
+ * A snapshot holds the content of every file in one read-only arena,
+ * along with a hash index and the status, type and validators of each
+ * file, so answers need no disk access at all. Snapshots are shared by
+ * all event loops and reference counted: a new one can replace the
+ * current one while answers are still being sent from the old one.
+ */
+
+#ifndef __SNAPSHOT__
+#define __SNAPSHOT__
+
+#include "filecache.h"
+
+#include <stddef.h>
+
+/** \brief Maximal depth of directories below the root that are loaded */
+#define SNAPSHOT_MAX_DEPTH 32
+
+/** \brief The files of a directory tree, loaded at one point in time */
+struct snapshot
+{
+  /** \brief The content of all files, read-only */
+  char * arena;
+  /** \brief Size of \a arena */
+  size_t arenaSize;
+  /** \brief The files, their data points into \a arena */
+  struct cachedFile * files;
+  /** \brief Number of \a files */
+  unsigned int fileCount;
+  /** \brief Hash index of \a files */
+  struct cachedFile ** buckets;
+  /** \brief Number of \a buckets minus one (a power of two minus one) */
+  unsigned int bucketMask;
+  /** \brief References held by event loops, answers and the current slot */
+  int references;
+};
+
+struct snapshot * buildSnapshot(const char * root, const char * const * extraFiles);
+
+struct cachedFile * findSnapshotFile(struct snapshot * snapshot, const char * path);
+
+void retainSnapshot(struct snapshot * snapshot);
+
+void releaseSnapshot(struct snapshot * snapshot);
+
+#endif
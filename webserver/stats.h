@@ -0,0 +1,20 @@
+/**
+ * \file stats.h
+ * \brief Counters that one event loop writes and the status report reads.
+ *
+ * Only the owning loop changes a counter, so it may read it plainly. The
+ * others read it with \a STATS_READ while it may change, which needs
+ * atomic accesses on both sides. Relaxed ones are plain moves on common
+ * processors, a report just sees some recent value.
+ */
+#ifndef __STATS__
+#define __STATS__
+
+/** \brief Adds \a delta to a counter of the calling loop */
+#define STATS_ADD(counter, delta) __atomic_store_n(&(counter), (counter) + (delta), __ATOMIC_RELAXED)
+/** \brief Subtracts \a delta from a counter of the calling loop */
+#define STATS_SUB(counter, delta) __atomic_store_n(&(counter), (counter) - (delta), __ATOMIC_RELAXED)
+/** \brief Reads a counter of any loop */
+#define STATS_READ(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+#endif
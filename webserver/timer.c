@@ -0,0 +1,175 @@
+/**
+ * \file timer.c
+ * \brief Implementation of a hierarchical timer wheel.
+ *
+ * Level 0 holds the timers due within the next \a TIMER_SLOTS ticks, one
+ * slot per tick. Every higher level covers \a TIMER_SLOTS times the range
+ * of the one below. Whenever level 0 wraps around, the next slot of
+ * level 1 is cascaded down, and so on.
+ */
+#include "timer.h"
+
+#include <string.h>
+
+/** \brief Mask to get a slot index */
+#define SLOT_MASK (TIMER_SLOTS - 1)
+
+/**
+ * Makes a slot head an empty circular list.
+ */
+void initSlot(struct timer * head)
+{
+  head->prev = head->next = head;
+}
+
+/**
+ * Initializes an empty wheel.
+ * \param wheel The wheel to initialize.
+ * \param nowMs The current time.
+ */
+void initTimerWheel(struct timerWheel * wheel, unsigned long nowMs)
+{
+  int level, slot;
+  memset(wheel, 0, sizeof(struct timerWheel));
+  for (level = 0; level < TIMER_LEVELS; ++level)
+    for (slot = 0; slot < TIMER_SLOTS; ++slot)
+      initSlot(&wheel->slots[level][slot]);
+  wheel->now = nowMs / TIMER_TICK_MS;
+}
+
+/**
+ * Links a timer into the slot matching its expiry tick.
+ */
+void insertTimer(struct timerWheel * wheel, struct timer * timer)
+{
+  unsigned long delta = timer->expires - wheel->now;
+  int level = 0;
+  /* timers beyond the range of the wheel wait in the last level */
+  if (delta >= (1UL << (TIMER_LEVELS * TIMER_SLOT_BITS)))
+    timer->expires = wheel->now + (1UL << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1;
+  while (level < TIMER_LEVELS - 1 && delta >= (1UL << ((level + 1) * TIMER_SLOT_BITS)))
+    ++level;
+  struct timer * head = &wheel->slots[level][(timer->expires >> (level * TIMER_SLOT_BITS)) & SLOT_MASK];
+  timer->next = head;
+  timer->prev = head->prev;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+/**
+ * Starts a timer. A pending timer is restarted.
+ * \param wheel The wheel to add the timer to.
+ * \param timer The timer.
+ * \param expiresMs The time at which the timer expires.
+ */
+void addTimer(struct timerWheel * wheel, struct timer * timer, unsigned long expiresMs)
+{
+  removeTimer(wheel, timer);
+  timer->expires = (expiresMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+  /* the current tick has been processed already */
+  if ((long)(timer->expires - wheel->now) <= 0)
+    timer->expires = wheel->now + 1;
+  insertTimer(wheel, timer);
+  ++wheel->count;
+}
+
+/**
+ * Stops a timer. Stopping a timer that is not pending does nothing.
+ * \param wheel The wheel the timer was added to.
+ * \param timer The timer.
+ */
+void removeTimer(struct timerWheel * wheel, struct timer * timer)
+{
+  if (timer->next == 0)
+    return;
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = timer->next = 0;
+  --wheel->count;
+}
+
+/**
+ * Moves the timers of a slot of a higher level down to the lower levels.
+ * \returns The index of the cascaded slot, 0 means the level wrapped around.
+ */
+int cascade(struct timerWheel * wheel, int level)
+{
+  int index = (wheel->now >> (level * TIMER_SLOT_BITS)) & SLOT_MASK;
+  struct timer * head = &wheel->slots[level][index];
+  struct timer * timer = head->next;
+  initSlot(head);
+  while (timer != head)
+  {
+    struct timer * next = timer->next;
+    insertTimer(wheel, timer);
+    timer = next;
+  }
+  return index;
+}
+
+/**
+ * Processes all ticks up to the given time and calls \a expired for every
+ * timer that expires. The callback may add and remove timers.
+ * \param wheel The wheel to advance.
+ * \param nowMs The current time.
+ * \param expired Callback for expired timers, they are not pending anymore when it is called.
+ */
+void advanceTimerWheel(struct timerWheel * wheel, unsigned long nowMs, void (*expired)(struct timer *))
+{
+  unsigned long target = nowMs / TIMER_TICK_MS;
+  while ((long)(target - wheel->now) > 0)
+  {
+    /* nothing to do, skip ahead */
+    if (wheel->count == 0)
+    {
+      wheel->now = target;
+      return;
+    }
+    ++wheel->now;
+    int index = wheel->now & SLOT_MASK;
+    int level = 1;
+    /* refill level 0 when it wrapped around, and higher levels as necessary */
+    if (index == 0)
+      while (level < TIMER_LEVELS && cascade(wheel, level) == 0)
+        ++level;
+    /* detach the due timers so the callbacks can modify the wheel */
+    struct timer due;
+    struct timer * head = &wheel->slots[0][index];
+    if (head->next == head)
+      continue;
+    due.next = head->next;
+    due.prev = head->prev;
+    due.next->prev = &due;
+    due.prev->next = &due;
+    initSlot(head);
+    while (due.next != &due)
+    {
+      struct timer * timer = due.next;
+      removeTimer(wheel, timer);
+      expired(timer);
+    }
+  }
+}
+
+/**
+ * Computes how long to sleep at most without missing a timer.
+ * \param wheel The wheel to check.
+ * \param nowMs The current time.
+ * \returns The timeout in milliseconds, -1 if no timer is pending.
+ */
+int nextTimerTimeout(const struct timerWheel * wheel, unsigned long nowMs)
+{
+  if (wheel->count == 0)
+    return -1;
+  /* a cascade may bring down earlier timers, wake up for it at the latest */
+  unsigned long untilCascade = TIMER_SLOTS - (wheel->now & SLOT_MASK);
+  unsigned long ticks;
+  for (ticks = 1; ticks < untilCascade; ++ticks)
+  {
+    const struct timer * head = &wheel->slots[0][(wheel->now + ticks) & SLOT_MASK];
+    if (head->next != head)
+      break;
+  }
+  long timeout = (long)((wheel->now + ticks) * TIMER_TICK_MS - nowMs);
+  return timeout < 0 ? 0 : (int)timeout;
+}
@@ -0,0 +1,54 @@
+/**
+ * \file timer.h
+ * \brief A hierarchical timer wheel.
+ *
+ * Timers are embedded into the objects they belong to. Adding, removing
+ * and expiring a timer takes constant time, independent of the number of
+ * timers. Times are given in milliseconds and rounded to \a TIMER_TICK_MS.
+ */
+
+#ifndef __TIMER__
+#define __TIMER__
+
+/** \brief Resolution of the wheel in milliseconds */
+#define TIMER_TICK_MS 100
+/** \brief Number of slots per level as a power of two */
+#define TIMER_SLOT_BITS 6
+/** \brief Number of slots per level */
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+/** \brief Number of levels, covering TIMER_SLOTS^TIMER_LEVELS ticks */
+#define TIMER_LEVELS 4
+
+/** \brief A timer, to be embedded into the object it belongs to */
+struct timer
+{
+  /** \brief Previous timer in the same slot, 0 if the timer is not pending */
+  struct timer * prev;
+  /** \brief Next timer in the same slot, 0 if the timer is not pending */
+  struct timer * next;
+  /** \brief Tick at which the timer expires */
+  unsigned long expires;
+};
+
+/** \brief A wheel of pending timers */
+struct timerWheel
+{
+  /** \brief The last tick that has been processed */
+  unsigned long now;
+  /** \brief Number of pending timers */
+  unsigned long count;
+  /** \brief List heads of all slots of all levels */
+  struct timer slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+void initTimerWheel(struct timerWheel * wheel, unsigned long nowMs);
+
+void addTimer(struct timerWheel * wheel, struct timer * timer, unsigned long expiresMs);
+
+void removeTimer(struct timerWheel * wheel, struct timer * timer);
+
+void advanceTimerWheel(struct timerWheel * wheel, unsigned long nowMs, void (*expired)(struct timer *));
+
+int nextTimerTimeout(const struct timerWheel * wheel, unsigned long nowMs);
+
+#endif
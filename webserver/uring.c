@@ -0,0 +1,176 @@
+/**
+ * \file uring.c
+ * \brief Implementation of a minimal io_uring submission and completion ring.
+ */
+#define _GNU_SOURCE
+#include "uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Initializes and maps a new ring.
+ * \param ring The ring structure to fill.
+ * \param entries Requested number of submission queue entries.
+ * \returns 0 on success, -1 otherwise and errno is set.
+ */
+int initUring(struct uring * ring, unsigned entries)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(ring, 0, sizeof(struct uring));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd == -1)
+    return -1;
+
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  /* newer kernels share one mapping for both rings */
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (ring->cqRingSize > ring->sqRingSize)
+      ring->sqRingSize = ring->cqRingSize;
+    ring->cqRingSize = ring->sqRingSize;
+  }
+  ring->sqRing = mmap(0, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sqRing == MAP_FAILED)
+    goto error;
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    ring->cqRing = ring->sqRing;
+  else
+  {
+    ring->cqRing = mmap(0, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED)
+      goto error;
+  }
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(0, ring->sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    goto error;
+
+  ring->sqHead = (unsigned *)((char *)ring->sqRing + params.sq_off.head);
+  ring->sqTail = (unsigned *)((char *)ring->sqRing + params.sq_off.tail);
+  ring->sqMask = (unsigned *)((char *)ring->sqRing + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned *)((char *)ring->sqRing + params.sq_off.array);
+  ring->sqEntries = params.sq_entries;
+  ring->cqHead = (unsigned *)((char *)ring->cqRing + params.cq_off.head);
+  ring->cqTail = (unsigned *)((char *)ring->cqRing + params.cq_off.tail);
+  ring->cqMask = (unsigned *)((char *)ring->cqRing + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)((char *)ring->cqRing + params.cq_off.cqes);
+  return 0;
+
+error:
+  {
+    int savedErrno = errno;
+    freeUring(ring);
+    errno = savedErrno;
+  }
+  return -1;
+}
+
+/**
+ * Unmaps and closes a ring.
+ * \param ring The ring to free.
+ */
+void freeUring(struct uring * ring)
+{
+  if (ring->sqes != 0 && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqRing != 0 && ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing)
+    munmap(ring->cqRing, ring->cqRingSize);
+  if (ring->sqRing != 0 && ring->sqRing != MAP_FAILED)
+    munmap(ring->sqRing, ring->sqRingSize);
+  if (ring->fd > 0)
+    close(ring->fd);
+  memset(ring, 0, sizeof(struct uring));
+}
+
+/**
+ * Returns a cleared submission queue entry to be filled by the caller.
+ * If the queue is full, the pending entries are submitted first.
+ * \param ring The ring to queue the entry on.
+ * \returns The entry or 0 if the queue could not be flushed.
+ */
+struct io_uring_sqe * getUringSqe(struct uring * ring)
+{
+  unsigned tail = *ring->sqTail;
+  if (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries)
+  {
+    if (submitUring(ring, 0, -1) == -1)
+      return 0;
+    if (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >= ring->sqEntries)
+      return 0;
+  }
+  unsigned index = tail & *ring->sqMask;
+  struct io_uring_sqe * sqe = ring->sqes + index;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  ring->sqArray[index] = index;
+  __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+  ++ring->sqPending;
+  return sqe;
+}
+
+/**
+ * Submits all queued entries with a single system call and optionally waits
+ * for completions.
+ * \param ring The ring to submit.
+ * \param waitFor Number of completions to wait for (0 to return at once).
+ * \param timeoutMs Maximum time to wait in milliseconds, -1 to wait forever.
+ * \returns The number of submitted entries or -1 and errno is set
+ * (ETIME if the wait timed out before anything was submitted).
+ */
+int submitUring(struct uring * ring, unsigned waitFor, int timeoutMs)
+{
+  int result;
+  unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec timeout;
+  void * argument = 0;
+  size_t argumentSize = 0;
+  if (waitFor > 0 && timeoutMs >= 0)
+  {
+    memset(&arg, 0, sizeof(arg));
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    arg.ts = (unsigned long)&timeout;
+    flags |= IORING_ENTER_EXT_ARG;
+    argument = &arg;
+    argumentSize = sizeof(arg);
+  }
+  do
+  {
+    result = syscall(__NR_io_uring_enter, ring->fd, ring->sqPending, waitFor,
+                     flags, argument, argumentSize);
+  } while (result == -1 && errno == EINTR);
+  if (result > 0)
+    ring->sqPending -= result;
+  return result;
+}
+
+/**
+ * Returns the next completion without consuming it.
+ * \param ring The ring to look at.
+ * \returns The completion or 0 if there is none.
+ */
+struct io_uring_cqe * peekUringCqe(struct uring * ring)
+{
+  unsigned head = *ring->cqHead;
+  if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    return 0;
+  return ring->cqes + (head & *ring->cqMask);
+}
+
+/**
+ * Marks the completion returned by \a peekUringCqe as consumed.
+ * \param ring The ring whose completion was handled.
+ */
+void advanceUringCq(struct uring * ring)
+{
+  __atomic_store_n(ring->cqHead, *ring->cqHead + 1, __ATOMIC_RELEASE);
+}
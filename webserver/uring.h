@@ -0,0 +1,66 @@
+/**
+ * \file uring.h
+ * \brief A minimal io_uring submission and completion ring.
+ *
+ * Talks to the kernel through the raw system calls, so no additional
+ * library is needed.
+ */
+
+#ifndef __URING__
+#define __URING__
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+/** \brief A mapped io_uring instance */
+struct uring
+{
+  /** \brief File descriptor of the ring */
+  int fd;
+  /** \brief Head of the submission queue (advanced by the kernel) */
+  unsigned * sqHead;
+  /** \brief Tail of the submission queue (advanced by us) */
+  unsigned * sqTail;
+  /** \brief Mask to map submission queue positions to indices */
+  unsigned * sqMask;
+  /** \brief Indirection array from submission queue positions to \a sqes */
+  unsigned * sqArray;
+  /** \brief Number of entries in the submission queue */
+  unsigned sqEntries;
+  /** \brief The submission queue entries */
+  struct io_uring_sqe * sqes;
+  /** \brief Number of entries queued since the last submission */
+  unsigned sqPending;
+  /** \brief Head of the completion queue (advanced by us) */
+  unsigned * cqHead;
+  /** \brief Tail of the completion queue (advanced by the kernel) */
+  unsigned * cqTail;
+  /** \brief Mask to map completion queue positions to indices */
+  unsigned * cqMask;
+  /** \brief The completion queue entries */
+  struct io_uring_cqe * cqes;
+  /** \brief Mapping of the submission ring */
+  void * sqRing;
+  /** \brief Size of the \a sqRing mapping */
+  size_t sqRingSize;
+  /** \brief Mapping of the completion ring (may equal \a sqRing) */
+  void * cqRing;
+  /** \brief Size of the \a cqRing mapping */
+  size_t cqRingSize;
+  /** \brief Size of the \a sqes mapping */
+  size_t sqesSize;
+};
+
+int initUring(struct uring * ring, unsigned entries);
+
+void freeUring(struct uring * ring);
+
+struct io_uring_sqe * getUringSqe(struct uring * ring);
+
+int submitUring(struct uring * ring, unsigned waitFor, int timeoutMs);
+
+struct io_uring_cqe * peekUringCqe(struct uring * ring);
+
+void advanceUringCq(struct uring * ring);
+
+#endif
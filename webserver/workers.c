@@ -0,0 +1,136 @@
+/**
+ * \file workers.c
+ * \brief Implementation of the worker thread pool.
+ */
+#define _GNU_SOURCE
+
+#include "workers.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Appends a job to a list.
+ */
+void appendJob(struct workerJob ** first, struct workerJob ** last, struct workerJob * job)
+{
+  job->next = 0;
+  if (*first == 0)
+    *first = job;
+  else
+    (*last)->next = job;
+  *last = job;
+}
+
+/**
+ * Hands a job that has been run back to its event loop.
+ * \param job The job, it belongs to the loop again.
+ */
+void completeJob(struct workerJob * job)
+{
+  struct completionQueue * queue = job->completions;
+  pthread_mutex_lock(&queue->lock);
+  int wasEmpty = queue->first == 0;
+  appendJob(&queue->first, &queue->last, job);
+  /* the loop takes all jobs at once, it was woken up for the others already;
+     under the lock, the loop may be gone once it took the last job */
+  const uint64_t one = 1;
+  if (wasEmpty && write(queue->fd, &one, sizeof(one)) == -1)
+    perror("Error waking up event loop");
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * Thread entry point of the workers: runs the jobs in the order they were
+ * submitted.
+ * \param argument The pool.
+ * \returns Nothing, the workers do not terminate
+ */
+void * runWorker(void * argument)
+{
+  struct workerPool * pool = argument;
+  for (;;)
+  {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->first == 0)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    struct workerJob * job = pool->first;
+    pool->first = job->next;
+    pthread_mutex_unlock(&pool->lock);
+    pool->run(job);
+    completeJob(job);
+  }
+  return 0;
+}
+
+/**
+ * Starts the worker threads of a pool. They inherit the signal mask of the
+ * calling thread.
+ * \param pool The pool to initialize.
+ * \param threadCount Number of threads.
+ * \param run Runs a job in a worker thread.
+ * \returns 0 on success, an error number if a thread could not be started.
+ */
+int startWorkerPool(struct workerPool * pool, int threadCount, void (*run)(struct workerJob *))
+{
+  memset(pool, 0, sizeof(struct workerPool));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pool->run = run;
+  int i;
+  for (i = 0; i < threadCount; ++i)
+  {
+    pthread_t thread;
+    int result = pthread_create(&thread, NULL, runWorker, pool);
+    if (result != 0)
+      return result;
+    pthread_detach(thread);
+    ++pool->threadCount;
+  }
+  return 0;
+}
+
+/**
+ * Queues a job for the next free worker.
+ * \param pool The pool.
+ * \param job The job, it belongs to the pool until it shows up in \a completions.
+ * \param completions The queue of the submitting event loop.
+ */
+void submitJob(struct workerPool * pool, struct workerJob * job, struct completionQueue * completions)
+{
+  job->completions = completions;
+  pthread_mutex_lock(&pool->lock);
+  appendJob(&pool->first, &pool->last, job);
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Initializes an empty completion queue.
+ * \param queue The queue to initialize.
+ * \param fd The eventfd to signal, which the event loop watches.
+ */
+void initCompletionQueue(struct completionQueue * queue, int fd)
+{
+  memset(queue, 0, sizeof(struct completionQueue));
+  pthread_mutex_init(&queue->lock, NULL);
+  queue->fd = fd;
+}
+
+/**
+ * Takes all jobs that have been run so far out of a queue. The event loop
+ * calls this after reading the eventfd, so later jobs signal it again.
+ * \param queue The queue.
+ * \returns The oldest job, linked to the others by \a next, or 0 if there are none.
+ */
+struct workerJob * takeCompletedJobs(struct completionQueue * queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  struct workerJob * jobs = queue->first;
+  queue->first = 0;
+  queue->last = 0;
+  pthread_mutex_unlock(&queue->lock);
+  return jobs;
+}
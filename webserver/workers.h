@@ -0,0 +1,66 @@
+/**
+ * \file workers.h
+ * \brief A pool of threads for calls that may block.
+ *
+ * An event loop hands a job to the pool and goes on serving its other
+ * clients. A worker runs the job and appends it to the completion queue
+ * the loop submitted it with, whose eventfd then becomes readable, so the
+ * loop takes the job back when it waits for events anyway. Jobs are
+ * embedded into the objects they belong to.
+ */
+
+#ifndef __WORKERS__
+#define __WORKERS__
+
+#include <pthread.h>
+
+struct completionQueue;
+
+/** \brief A job, to be embedded into the object it belongs to */
+struct workerJob
+{
+  /** \brief Next job in the same queue */
+  struct workerJob * next;
+  /** \brief The queue the job goes to once it has been run */
+  struct completionQueue * completions;
+};
+
+/** \brief Jobs that have been run, waiting for their event loop */
+struct completionQueue
+{
+  /** \brief Guards the list, workers append to it */
+  pthread_mutex_t lock;
+  /** \brief The oldest job, 0 if there is none */
+  struct workerJob * first;
+  /** \brief The newest job */
+  struct workerJob * last;
+  /** \brief eventfd that is signalled when the list stops being empty */
+  int fd;
+};
+
+/** \brief The worker threads and the jobs waiting for them */
+struct workerPool
+{
+  /** \brief Guards the list */
+  pthread_mutex_t lock;
+  /** \brief Signalled when a job is added */
+  pthread_cond_t wake;
+  /** \brief The oldest job, 0 if there is none */
+  struct workerJob * first;
+  /** \brief The newest job */
+  struct workerJob * last;
+  /** \brief Runs a job in a worker thread */
+  void (*run)(struct workerJob *);
+  /** \brief Number of worker threads */
+  int threadCount;
+};
+
+int startWorkerPool(struct workerPool * pool, int threadCount, void (*run)(struct workerJob *));
+
+void submitJob(struct workerPool * pool, struct workerJob * job, struct completionQueue * completions);
+
+void initCompletionQueue(struct completionQueue * queue, int fd);
+
+struct workerJob * takeCompletedJobs(struct completionQueue * queue);
+
+#endif